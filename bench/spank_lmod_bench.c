@@ -0,0 +1,411 @@
+/******************************************************************************
+ *
+ *   spank_lmod_bench.c
+ *
+ *   Copyright (C) 2026 Hebrew University of Jerusalem Israel, see
+ *   LICENSE file.
+ *
+ *   Author: Yair Yarom <irush@cs.huji.ac.il>
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc., 59
+ *   Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ *****************************************************************************/
+
+/*
+  Measures the step launch latency added by spank_lmod and the lmod
+  TaskProlog, without slurm. Linked with spank_lmod.c, and provides the spank
+  functions it uses.
+
+  A fake Lmod (a bash "module" function, through BASH_ENV) and a module tree
+  of -m modules are created in a temporary directory. Each iteration runs in a
+  new process (as srun/slurmstepd would) with an environment of -e additional
+  variables and --module of -l modules:
+  - local/allocator: slurm_spank_init() to slurm_spank_init_post_opt(), with
+    an empty (cold) or primed (warm) cache.
+  - remote: the slurmstepd hooks and then -t concurrent TaskProlog runs, once
+    per step (remote=yes) and in each task (remote=no).
+
+  Latency percentiles (ms) of each are printed.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <spawn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <slurm/spank.h>
+
+extern char **environ;
+
+extern int slurm_spank_init(spank_t spank, int ac, char **av);
+extern int slurm_spank_init_post_opt(spank_t spank, int ac, char **av);
+extern int slurm_spank_user_init(spank_t spank, int ac, char **av);
+
+static const char *lmod_sh =
+    "module() {\n"
+    "    local cmd=$1 m f\n"
+    "    shift\n"
+    "    # lmod's own start up time\n"
+    "    [ \"$BENCH_LMOD_DELAY\" != 0 ] && sleep \"$BENCH_LMOD_DELAY\"\n"
+    "    case $cmd in\n"
+    "    reset)\n"
+    "        export MODULEPATH=$BENCH_ROOT/modules\n"
+    "        unset LOADEDMODULES _LMFILES_\n"
+    "        ;;\n"
+    "    load|try-load)\n"
+    "        for m in \"$@\"; do\n"
+    "            f=$(ls -d \"$MODULEPATH/$m\"* 2>/dev/null | head -1)\n"
+    "            [ -n \"$f\" ] || continue\n"
+    "            export LOADEDMODULES=${LOADEDMODULES:+$LOADEDMODULES:}$m\n"
+    "            export _LMFILES_=${_LMFILES_:+$_LMFILES_:}$f\n"
+    "            export PATH=$BENCH_ROOT/apps/$m/bin:$PATH\n"
+    "            export LD_LIBRARY_PATH=$BENCH_ROOT/apps/$m/lib${LD_LIBRARY_PATH:+:$LD_LIBRARY_PATH}\n"
+    "            export MANPATH=$BENCH_ROOT/apps/$m/man${MANPATH:+:$MANPATH}\n"
+    "        done\n"
+    "        ;;\n"
+    "    esac\n"
+    "}\n";
+
+static int modules_count = 100;
+static int env_size = 300;
+static int tasks = 32;
+static int iterations = 20;
+static int load_count = 3;
+static const char *lmod_delay = "0";
+static const char *script = "proepilogs/TaskProlog-lmod.sh";
+static int keep = 0;
+
+static char root[PATH_MAX];
+static char modules[4096] = "";
+
+/* the spank "implementation" */
+static spank_context_t context;
+static struct spank_option *module_option;
+static char **job_env;
+static size_t job_env_count;
+
+spank_context_t spank_context(void) {
+    return context;
+}
+
+spank_err_t spank_option_register(spank_t spank, struct spank_option *opt) {
+    module_option = opt;
+    return ESPANK_SUCCESS;
+}
+
+spank_err_t spank_get_item(spank_t spank, spank_item_t item, ...) {
+    va_list ap;
+    if (item != S_JOB_ENV)
+        return ESPANK_BAD_ARG;
+    va_start(ap, item);
+    *va_arg(ap, char ***) = job_env;
+    va_end(ap);
+    return ESPANK_SUCCESS;
+}
+
+static ssize_t _job_env_find(const char *var) {
+    size_t len = strlen(var);
+    for (size_t i = 0; i < job_env_count; i++) {
+        if (strncmp(job_env[i], var, len) == 0 && job_env[i][len] == '=')
+            return i;
+    }
+    return -1;
+}
+
+spank_err_t spank_setenv(spank_t spank, const char *var, const char *val, int overwrite) {
+    ssize_t i = _job_env_find(var);
+    char *entry;
+    if (asprintf(&entry, "%s=%s", var, val) < 0)
+        return ESPANK_ERROR;
+    if (i < 0) {
+        job_env = realloc(job_env, (job_env_count + 2) * sizeof(char*));
+        i = job_env_count++;
+        job_env[job_env_count] = NULL;
+    }
+    job_env[i] = entry;
+    return ESPANK_SUCCESS;
+}
+
+spank_err_t spank_unsetenv(spank_t spank, const char *var) {
+    ssize_t i = _job_env_find(var);
+    if (i >= 0) {
+        job_env[i] = job_env[--job_env_count];
+        job_env[job_env_count] = NULL;
+    }
+    return ESPANK_SUCCESS;
+}
+
+spank_err_t spank_getenv(spank_t spank, const char *var, char *buf, int len) {
+    ssize_t i = _job_env_find(var);
+    if (i < 0)
+        return ESPANK_ENV_NOEXIST;
+    snprintf(buf, len, "%s", strchr(job_env[i], '=') + 1);
+    return ESPANK_SUCCESS;
+}
+
+void slurm_info(const char *format, ...) {}
+void slurm_verbose(const char *format, ...) {}
+void slurm_debug(const char *format, ...) {}
+void slurm_debug2(const char *format, ...) {}
+void slurm_debug3(const char *format, ...) {}
+
+void slurm_error(const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    fprintf(stderr, "error: ");
+    vfprintf(stderr, format, ap);
+    fprintf(stderr, "\n");
+    va_end(ap);
+}
+
+static void _usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-m <modules>] [-l <loaded>] [-e <variables>] [-t <tasks>] [-i <iterations>]\n"
+                    "          [-d <seconds>] [-s <script>] [-k]\n", prog);
+    fprintf(stderr, "  -m <modules>     modules in the fake module tree (100)\n");
+    fprintf(stderr, "  -l <loaded>      modules given to --module (3)\n");
+    fprintf(stderr, "  -e <variables>   additional environment variables (300)\n");
+    fprintf(stderr, "  -t <tasks>       tasks per node (32)\n");
+    fprintf(stderr, "  -i <iterations>  iterations of each measurement (20)\n");
+    fprintf(stderr, "  -d <seconds>     fake lmod start up time of each module command (0)\n");
+    fprintf(stderr, "  -s <script>      the lmod script (proepilogs/TaskProlog-lmod.sh)\n");
+    fprintf(stderr, "  -k               keep the temporary directory\n");
+    exit(2);
+}
+
+static double _now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void _write_file(const char *path, const char *data) {
+    FILE *f = fopen(path, "w");
+    if (!f || fputs(data, f) < 0 || fclose(f)) {
+        perror(path);
+        exit(1);
+    }
+}
+
+static void _mkdir(const char *path) {
+    if (mkdir(path, 0700) < 0 && errno != EEXIST) {
+        perror(path);
+        exit(1);
+    }
+}
+
+/* the fake lmod, module tree and environment */
+static void _setup(void) {
+    char path[PATH_MAX + 64], value[128];
+
+    snprintf(root, sizeof(root), "/tmp/spank_lmod_bench.XXXXXX");
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        exit(1);
+    }
+    snprintf(path, sizeof(path), "%s/lmod.sh", root);
+    _write_file(path, lmod_sh);
+    setenv("BASH_ENV", path, 1);
+    snprintf(path, sizeof(path), "%s/home", root);
+    _mkdir(path);
+    setenv("HOME", path, 1);
+    unsetenv("XDG_CACHE_HOME");
+    unsetenv("SPANK_MODULES");
+    unsetenv("SPANK_LMOD_APPLIED");
+    setenv("BENCH_ROOT", root, 1);
+    setenv("BENCH_LMOD_DELAY", lmod_delay, 1);
+
+    snprintf(path, sizeof(path), "%s/modules", root);
+    _mkdir(path);
+    for (int i = 0; i < modules_count; i++) {
+        snprintf(path, sizeof(path), "%s/modules/mod%d", root, i);
+        _mkdir(path);
+        for (int v = 1; v <= 2; v++) {
+            snprintf(path, sizeof(path), "%s/modules/mod%d/%d.0.lua", root, i, v);
+            _write_file(path, "-- fake\n");
+        }
+        if (i < load_count)
+            snprintf(modules + strlen(modules), sizeof(modules) - strlen(modules), "%smod%d", i ? "," : "", i);
+    }
+    for (int i = 0; i < env_size; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "BENCH_VAR_%d", i);
+        snprintf(value, sizeof(value), "%0*d", 64, i);
+        setenv(name, value, 1);
+    }
+}
+
+/* runs the TaskProlog of tasks tasks concurrently, with the job environment */
+static void _task_prologs(void) {
+    posix_spawn_file_actions_t actions;
+    pid_t *pids = calloc(tasks, sizeof(pid_t));
+    char *argv[] = { (char *)script, NULL };
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    for (int i = 0; i < tasks; i++) {
+        if (posix_spawn(&pids[i], script, &actions, NULL, argv, job_env)) {
+            perror(script);
+            exit(1);
+        }
+    }
+    for (int i = 0; i < tasks; i++)
+        waitpid(pids[i], NULL, 0);
+    posix_spawn_file_actions_destroy(&actions);
+    free(pids);
+}
+
+/* a single measurement in a new process, returns the milliseconds it took */
+static double _measure(spank_context_t ctx, const char *arg) {
+    int pfd[2];
+    double ms = -1;
+    pid_t pid;
+
+    if (pipe(pfd) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    fflush(stdout);
+    if ((pid = fork()) == 0) {
+        char *av[] = { (char *)script, (char *)arg, NULL };
+        int ac = arg ? 2 : 1;
+        double start;
+
+        close(pfd[0]);
+        context = ctx;
+        start = _now_ms();
+        slurm_spank_init((spank_t)&context, ac, av);
+        if (module_option)
+            module_option->cb(module_option->val, modules, ctx == S_CTX_REMOTE);
+        if (ctx == S_CTX_REMOTE) {
+            // the job environment slurmstepd has
+            for (char **var = environ; *var; var++)
+                job_env_count++;
+            job_env = calloc(job_env_count + 1, sizeof(char*));
+            memcpy(job_env, environ, job_env_count * sizeof(char*));
+        }
+        slurm_spank_init_post_opt((spank_t)&context, ac, av);
+        if (ctx == S_CTX_REMOTE) {
+            slurm_spank_user_init((spank_t)&context, ac, av);
+            _task_prologs();
+        }
+        ms = _now_ms() - start;
+        if (write(pfd[1], &ms, sizeof(ms)) != sizeof(ms))
+            exit(1);
+        exit(0);
+    }
+    close(pfd[1]);
+    if (pid < 0 || read(pfd[0], &ms, sizeof(ms)) != sizeof(ms)) {
+        fprintf(stderr, "measurement failed\n");
+        exit(1);
+    }
+    close(pfd[0]);
+    waitpid(pid, NULL, 0);
+    return ms;
+}
+
+static int _cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void _report(const char *name, const char *mode, double *ms, int n) {
+    qsort(ms, n, sizeof(double), _cmp_double);
+    printf("%-10s %-6s %5d %9.2f %9.2f %9.2f %9.2f\n", name, mode, n,
+           ms[(n - 1) * 50 / 100], ms[(n - 1) * 90 / 100], ms[(n - 1) * 99 / 100], ms[n - 1]);
+}
+
+static void _clear_cache(void) {
+    char cmd[PATH_MAX + 32];
+    snprintf(cmd, sizeof(cmd), "rm -rf '%s/cache'", root);
+    if (system(cmd))
+        exit(1);
+}
+
+int main(int argc, char **argv) {
+    char cache_arg[PATH_MAX + 16];
+    double *ms;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:l:e:t:i:d:s:kh")) != -1) {
+        switch (opt) {
+        case 'm': modules_count = atoi(optarg); break;
+        case 'l': load_count = atoi(optarg); break;
+        case 'e': env_size = atoi(optarg); break;
+        case 't': tasks = atoi(optarg); break;
+        case 'i': iterations = atoi(optarg); break;
+        case 'd': lmod_delay = optarg; break;
+        case 's': script = optarg; break;
+        case 'k': keep = 1; break;
+        default: _usage(argv[0]);
+        }
+    }
+    if (optind != argc || iterations < 1 || tasks < 1 || load_count > modules_count)
+        _usage(argv[0]);
+    if (access(script, X_OK) < 0) {
+        perror(script);
+        return 1;
+    }
+    script = realpath(script, NULL);
+
+    _setup();
+    snprintf(cache_arg, sizeof(cache_arg), "cache_dir=%s/cache", root);
+    ms = calloc(iterations, sizeof(double));
+
+    printf("script %s, %d modules, %d loaded, %d variables, %d tasks\n",
+           script, modules_count, load_count, env_size, tasks);
+    printf("%-10s %-6s %5s %9s %9s %9s %9s\n", "context", "mode", "n", "p50", "p90", "p99", "max");
+
+    for (int allocator = 0; allocator <= 1; allocator++) {
+        spank_context_t ctx = allocator ? S_CTX_ALLOCATOR : S_CTX_LOCAL;
+        const char *name = allocator ? "allocator" : "local";
+        for (int i = 0; i < iterations; i++) {
+            _clear_cache();
+            ms[i] = _measure(ctx, cache_arg);
+        }
+        _report(name, "cold", ms, iterations);
+        _measure(ctx, cache_arg);
+        for (int i = 0; i < iterations; i++)
+            ms[i] = _measure(ctx, cache_arg);
+        _report(name, "warm", ms, iterations);
+    }
+
+    // once per step against once per task
+    for (int i = 0; i < iterations; i++)
+        ms[i] = _measure(S_CTX_REMOTE, "remote=yes");
+    _report("remote", "step", ms, iterations);
+    for (int i = 0; i < iterations; i++)
+        ms[i] = _measure(S_CTX_REMOTE, "remote=no");
+    _report("remote", "task", ms, iterations);
+
+    if (!keep) {
+        char cmd[PATH_MAX + 32];
+        snprintf(cmd, sizeof(cmd), "rm -rf '%s'", root);
+        if (system(cmd))
+            return 1;
+    } else {
+        printf("kept %s\n", root);
+    }
+    free(ms);
+    return 0;
+}
@@ -0,0 +1,331 @@
+/******************************************************************************
+ *
+ *   feature_expr.h
+ *
+ *   Copyright (C) 2026 Hebrew University of Jerusalem Israel, see
+ *   LICENSE file.
+ *
+ *   Author: Yair Yarom <irush@cs.huji.ac.il>
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc., 59
+ *   Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ *****************************************************************************/
+
+/*
+  Parser for slurm feature expressions (--constraint), e.g.
+  "cpuonly&(avx2|avx512)", "[rack1*2&rack2*4]", "[ib|eth]&haswell".
+
+  The expression is parsed into a tree of AND/OR nodes (parenthesis are
+  dropped), matching brackets are kept as a node of their own, and counts
+  ("name*N") are kept on the leaves. Like slurm, operators without
+  parenthesis are evaluated left to right, so "a|b&c" is "(a|b)&c".
+
+  feature_expr_normalize() flattens nested operators of the same kind and
+  removes duplicates and absorbed terms ("a&(a|b)" is "a"), leaving counts
+  and brackets alone, and feature_expr_write() writes the tree back with
+  parenthesis only where the operator changes.
+
+  Anything not understood (e.g. "!" or spaces) fails the parse, and the caller
+  should leave the expression alone.
+
+  Everything is static, each plugin including this gets its own copy.
+*/
+
+#ifndef _FEATURE_EXPR_H
+#define _FEATURE_EXPR_H
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+
+typedef enum {
+    FEATURE_LEAF,
+    FEATURE_AND,
+    FEATURE_OR,
+    FEATURE_BRACKET,    // matching OR / multiple counts, single child
+} feature_type_t;
+
+typedef struct feature_expr {
+    feature_type_t type;
+    char* name;         // FEATURE_LEAF
+    int count;          // FEATURE_LEAF, 0 if none
+    int n_children;
+    struct feature_expr** children;
+} feature_expr_t;
+
+static inline void feature_expr_free(feature_expr_t* expr) {
+    if (!expr)
+        return;
+    for (int i = 0; i < expr->n_children; i++)
+        feature_expr_free(expr->children[i]);
+    xfree(expr->children);
+    xfree(expr->name);
+    xfree(expr);
+}
+
+static inline feature_expr_t* feature_expr_leaf(const char* name, size_t len, int count) {
+    feature_expr_t* expr = xmalloc(sizeof(feature_expr_t));
+    expr->type = FEATURE_LEAF;
+    expr->name = xstrndup(name, len);
+    expr->count = count;
+    return expr;
+}
+
+static inline void feature_expr_add_child(feature_expr_t* expr, feature_expr_t* child) {
+    xrealloc(expr->children, (expr->n_children + 1) * sizeof(feature_expr_t*));
+    expr->children[expr->n_children++] = child;
+}
+
+/* returns a new node of type with the two children */
+static inline feature_expr_t* feature_expr_op(feature_type_t type, feature_expr_t* left, feature_expr_t* right) {
+    feature_expr_t* expr = xmalloc(sizeof(feature_expr_t));
+    expr->type = type;
+    feature_expr_add_child(expr, left);
+    if (right)
+        feature_expr_add_child(expr, right);
+    return expr;
+}
+
+static inline bool _feature_name_char(char c) {
+    return c && !strchr("&|[]()*,!<>= \t\n", c);
+}
+
+static feature_expr_t* _feature_parse_expr(const char** p);
+
+static inline feature_expr_t* _feature_parse_term(const char** p) {
+    feature_expr_t* expr = NULL;
+    if (**p == '(' || **p == '[') {
+        char close = (**p == '(') ? ')' : ']';
+        bool bracket = (**p == '[');
+        (*p)++;
+        expr = _feature_parse_expr(p);
+        if (!expr)
+            return NULL;
+        if (**p != close) {
+            feature_expr_free(expr);
+            return NULL;
+        }
+        (*p)++;
+        if (bracket)
+            expr = feature_expr_op(FEATURE_BRACKET, expr, NULL);
+        return expr;
+    }
+
+    const char* start = *p;
+    while (_feature_name_char(**p))
+        (*p)++;
+    if (*p == start)
+        return NULL;
+    size_t len = *p - start;
+    int count = 0;
+    if (**p == '*') {
+        char* end;
+        (*p)++;
+        if (**p < '0' || **p > '9')
+            return NULL;
+        count = strtol(*p, &end, 10);
+        *p = end;
+    }
+    return feature_expr_leaf(start, len, count);
+}
+
+static feature_expr_t* _feature_parse_expr(const char** p) {
+    feature_expr_t* left = _feature_parse_term(p);
+    if (!left)
+        return NULL;
+    while (**p == '&' || **p == '|') {
+        feature_type_t type = (**p == '&') ? FEATURE_AND : FEATURE_OR;
+        (*p)++;
+        feature_expr_t* right = _feature_parse_term(p);
+        if (!right) {
+            feature_expr_free(left);
+            return NULL;
+        }
+        // left to right: a|b&c is (a|b)&c
+        if (left->type == type)
+            feature_expr_add_child(left, right);
+        else
+            left = feature_expr_op(type, left, right);
+    }
+    return left;
+}
+
+/* returns the tree of str, or NULL if empty or can't be parsed */
+static inline feature_expr_t* feature_expr_parse(const char* str) {
+    if (!str || !*str)
+        return NULL;
+    const char* p = str;
+    feature_expr_t* expr = _feature_parse_expr(&p);
+    if (expr && *p) {
+        feature_expr_free(expr);
+        expr = NULL;
+    }
+    return expr;
+}
+
+static inline bool feature_expr_equal(const feature_expr_t* a, const feature_expr_t* b) {
+    if (a->type != b->type || a->n_children != b->n_children)
+        return false;
+    if (a->type == FEATURE_LEAF)
+        return a->count == b->count && strcmp(a->name, b->name) == 0;
+    for (int i = 0; i < a->n_children; i++) {
+        if (!feature_expr_equal(a->children[i], b->children[i]))
+            return false;
+    }
+    return true;
+}
+
+/*
+  true if every node matching expr must have the feature name (i.e. without a
+  count, and not only in some of the alternatives)
+*/
+static inline bool feature_expr_requires(const feature_expr_t* expr, const char* name) {
+    switch (expr->type) {
+    case FEATURE_LEAF:
+        return expr->count == 0 && strcmp(expr->name, name) == 0;
+    case FEATURE_AND:
+        for (int i = 0; i < expr->n_children; i++) {
+            if (feature_expr_requires(expr->children[i], name))
+                return true;
+        }
+        return false;
+    case FEATURE_OR:
+    case FEATURE_BRACKET:
+        for (int i = 0; i < expr->n_children; i++) {
+            if (!feature_expr_requires(expr->children[i], name))
+                return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+static inline void _feature_remove_child(feature_expr_t* expr, int i) {
+    feature_expr_free(expr->children[i]);
+    memmove(&expr->children[i], &expr->children[i + 1], (expr->n_children - i - 1) * sizeof(feature_expr_t*));
+    expr->n_children--;
+}
+
+/* counts are per job, "a*2&a*2" isn't "a*2", so these are never merged */
+static inline bool _feature_counted(const feature_expr_t* expr) {
+    return expr->type == FEATURE_LEAF && expr->count;
+}
+
+/* true if one of the children of inner equals a child of outer other than inner */
+static inline bool _feature_absorbed(const feature_expr_t* outer, const feature_expr_t* inner) {
+    for (int i = 0; i < outer->n_children; i++) {
+        if (outer->children[i] == inner || _feature_counted(outer->children[i]))
+            continue;
+        for (int j = 0; j < inner->n_children; j++) {
+            if (feature_expr_equal(outer->children[i], inner->children[j]))
+                return true;
+        }
+    }
+    return false;
+}
+
+/*
+  returns the normalized expr (which may be a different node of the tree)
+  brackets are kept as is
+*/
+static inline feature_expr_t* feature_expr_normalize(feature_expr_t* expr) {
+    if (expr->type == FEATURE_LEAF || expr->type == FEATURE_BRACKET)
+        return expr;
+
+    for (int i = 0; i < expr->n_children; i++)
+        expr->children[i] = feature_expr_normalize(expr->children[i]);
+
+    // a&(b&c) is a&b&c
+    for (int i = 0; i < expr->n_children; i++) {
+        feature_expr_t* child = expr->children[i];
+        if (child->type != expr->type)
+            continue;
+        int n = child->n_children;
+        xrealloc(expr->children, (expr->n_children + n - 1) * sizeof(feature_expr_t*));
+        memmove(&expr->children[i + n], &expr->children[i + 1], (expr->n_children - i - 1) * sizeof(feature_expr_t*));
+        memcpy(&expr->children[i], child->children, n * sizeof(feature_expr_t*));
+        expr->n_children += n - 1;
+        child->n_children = 0;
+        feature_expr_free(child);
+        i += n - 1;
+    }
+
+    // a&a is a
+    for (int i = 1; i < expr->n_children; i++) {
+        if (_feature_counted(expr->children[i]))
+            continue;
+        for (int j = 0; j < i; j++) {
+            if (feature_expr_equal(expr->children[i], expr->children[j])) {
+                _feature_remove_child(expr, i--);
+                break;
+            }
+        }
+    }
+
+    // a&(a|b) is a, a|(a&b) is a
+    for (int i = 0; i < expr->n_children && expr->n_children > 1; i++) {
+        feature_expr_t* child = expr->children[i];
+        if ((child->type == FEATURE_AND || child->type == FEATURE_OR) && _feature_absorbed(expr, child))
+            _feature_remove_child(expr, i--);
+    }
+
+    if (expr->n_children == 1) {
+        feature_expr_t* child = expr->children[0];
+        expr->n_children = 0;
+        feature_expr_free(expr);
+        return child;
+    }
+    return expr;
+}
+
+static inline void _feature_write(const feature_expr_t* expr, char** str, feature_type_t parent) {
+    if (expr->type == FEATURE_LEAF) {
+        xstrcat(*str, expr->name);
+        if (expr->count)
+            xstrfmtcat(*str, "*%d", expr->count);
+        return;
+    }
+    if (expr->type == FEATURE_BRACKET) {
+        xstrcat(*str, "[");
+        _feature_write(expr->children[0], str, FEATURE_BRACKET);
+        xstrcat(*str, "]");
+        return;
+    }
+
+    // parenthesis only where the operator changes, so the result is the
+    // same left to right or with & before |
+    bool parens = (parent == FEATURE_AND || parent == FEATURE_OR) && parent != expr->type;
+    if (parens)
+        xstrcat(*str, "(");
+    for (int i = 0; i < expr->n_children; i++) {
+        if (i)
+            xstrcat(*str, expr->type == FEATURE_AND ? "&" : "|");
+        _feature_write(expr->children[i], str, expr->type);
+    }
+    if (parens)
+        xstrcat(*str, ")");
+}
+
+/* returns the expression as a string (xfree it) */
+static inline char* feature_expr_write(const feature_expr_t* expr) {
+    char* str = NULL;
+    _feature_write(expr, &str, FEATURE_LEAF);
+    return str;
+}
+
+#endif
@@ -0,0 +1,41 @@
+#!/bin/bash
+
+# Keeps a reservation of idle nodes for small interactive jobs (see
+# PoolReservation in limit_interactive.conf). The REPLACE flag makes slurm
+# replace nodes allocated to jobs with idle ones, so there are always <count>
+# warm nodes waiting. Run once, or from cron to follow changes to <count>.
+
+set -e
+set -u
+
+usage() {
+    echo "usage: $0 -r <reservation> -p <partition> -n <count> -a <accounts>" 1>&2
+    exit 1
+}
+
+resv=
+partition=
+count=
+accounts=
+
+while getopts "r:p:n:a:h" opt; do
+    case $opt in
+        r) resv=$OPTARG ;;
+        p) partition=$OPTARG ;;
+        n) count=$OPTARG ;;
+        a) accounts=$OPTARG ;;
+        *) usage ;;
+    esac
+done
+
+[[ -n "$resv" && -n "$partition" && -n "$count" && -n "$accounts" ]] || usage
+
+current=`scontrol show reservation "$resv" -o 2>/dev/null | tr ' ' '\n' | grep -P '^NodeCnt=' | cut -d= -f2 || true`
+
+if [[ -z "$current" ]]; then
+    scontrol create reservation ReservationName="$resv" PartitionName="$partition" \
+             NodeCnt="$count" Accounts="$accounts" StartTime=now Duration=infinite \
+             Flags=REPLACE
+elif [[ "$current" != "$count" ]]; then
+    scontrol update ReservationName="$resv" NodeCnt="$count"
+fi
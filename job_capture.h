@@ -0,0 +1,303 @@
+/******************************************************************************
+ *
+ *   job_capture.h
+ *
+ *   Copyright (C) 2026 Hebrew University of Jerusalem Israel, see
+ *   LICENSE file.
+ *
+ *   Author: Yair Yarom <irush@cs.huji.ac.il>
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc., 59
+ *   Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ *****************************************************************************/
+
+/*
+  Binary capture format of job descriptors, written by job_submit_info
+  (Format=binary) and read by job_submit_replay.
+
+  A capture file is a job_capture_file_hdr_t followed by records. Each record
+  is a job_capture_rec_hdr_t (whose len is the length of the whole record)
+  followed by nfields fields. A field is a job_capture_field_hdr_t followed by
+  len bytes of data:
+  - numbers are stored with the size of the job_desc_msg_t member
+  - strings are stored with their terminating NUL, NULL strings are omitted
+  - string arrays (argv, environment, ...) are a field per element
+  Everything is in host byte order, and nothing is aligned, so a file can be
+  mmap()ed and read in place (with memcpy for the numbers).
+
+  Field ids are part of the format, new fields get new ids.
+
+  Everything is static, each plugin including this gets its own copy.
+*/
+
+#ifndef _JOB_CAPTURE_H
+#define _JOB_CAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <slurm/slurm.h>
+
+#include "src/common/macros.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+
+#define JOB_CAPTURE_MAGIC "SLJCAP01"
+#define JOB_CAPTURE_VERSION 1
+
+typedef struct job_capture_file_hdr {
+    char magic[8];
+    uint32_t version;
+    uint32_t slurm_version;     // SLURM_VERSION_NUMBER of the writer
+} job_capture_file_hdr_t;
+
+typedef enum {
+    JOB_CAPTURE_SUBMIT = 1,
+    JOB_CAPTURE_DROPPED = 2,    // field 0 is the number of dropped records
+} job_capture_type_t;
+
+typedef struct job_capture_rec_hdr {
+    uint32_t len;       // of the whole record, including this header
+    uint16_t type;
+    uint16_t reserved;
+    int64_t time;
+    uint32_t submit_uid;
+    uint32_t nfields;   // a field per environment variable, can pass 64K
+} job_capture_rec_hdr_t;
+
+typedef struct job_capture_field_hdr {
+    uint16_t id;
+    uint16_t reserved;
+    uint32_t len;
+} job_capture_field_hdr_t;
+
+typedef enum {
+    JOB_CAPTURE_NUM,
+    JOB_CAPTURE_STR,
+    JOB_CAPTURE_ARRAY,  // char** with a uint32_t count member
+} job_capture_kind_t;
+
+typedef struct job_capture_field {
+    uint16_t id;
+    job_capture_kind_t kind;
+    const char* name;
+    size_t offset;
+    size_t size;            // JOB_CAPTURE_NUM
+    size_t count_offset;    // JOB_CAPTURE_ARRAY
+} job_capture_field_t;
+
+#define _JC_MEMBER_SIZE(member) sizeof(((job_desc_msg_t*)0)->member)
+#define _JC_NUM(id, member) { id, JOB_CAPTURE_NUM, #member, offsetof(job_desc_msg_t, member), _JC_MEMBER_SIZE(member), 0 }
+#define _JC_STR(id, member) { id, JOB_CAPTURE_STR, #member, offsetof(job_desc_msg_t, member), 0, 0 }
+#define _JC_ARRAY(id, member, count) { id, JOB_CAPTURE_ARRAY, #member, offsetof(job_desc_msg_t, member), 0, offsetof(job_desc_msg_t, count) }
+
+#define JOB_CAPTURE_MAX_ID 128
+
+static const job_capture_field_t job_capture_fields[] = {
+    _JC_STR(1, account),
+    _JC_STR(2, acctg_freq),
+    _JC_STR(3, alloc_node),
+    _JC_NUM(4, alloc_resp_port),
+    _JC_NUM(5, alloc_sid),
+    _JC_NUM(6, time_limit),
+    _JC_NUM(7, time_min),
+    _JC_ARRAY(8, argv, argc),
+    _JC_ARRAY(9, spank_job_env, spank_job_env_size),
+    _JC_ARRAY(10, environment, env_size),
+    _JC_STR(11, qos),
+    _JC_STR(12, std_err),
+    _JC_STR(13, std_in),
+    _JC_STR(14, std_out),
+    _JC_STR(15, licenses),
+    _JC_STR(16, job_id_str),
+    _JC_STR(17, script),
+    _JC_NUM(18, num_tasks),
+    _JC_NUM(19, ntasks_per_node),
+    _JC_NUM(20, ntasks_per_socket),
+    _JC_NUM(21, ntasks_per_core),
+    _JC_NUM(22, ntasks_per_board),
+    _JC_STR(23, req_nodes),
+    _JC_STR(24, exc_nodes),
+    _JC_NUM(25, min_nodes),
+    _JC_NUM(26, max_nodes),
+#if SLURM_VERSION_NUMBER < SLURM_VERSION_NUM(19,5,0)
+    _JC_STR(27, gres),
+#else
+    _JC_STR(28, tres_per_job),
+    _JC_STR(29, tres_per_node),
+    _JC_STR(30, tres_per_socket),
+    _JC_STR(31, tres_per_task),
+#endif
+    _JC_STR(32, partition),
+    _JC_STR(33, features),
+    _JC_STR(34, cluster_features),
+    _JC_STR(35, reservation),
+    _JC_STR(36, name),
+    _JC_STR(37, comment),
+    _JC_STR(38, work_dir),
+    _JC_STR(39, mail_user),
+    _JC_NUM(40, mail_type),
+    _JC_NUM(41, user_id),
+    _JC_NUM(42, group_id),
+    _JC_NUM(43, min_cpus),
+    _JC_NUM(44, cpus_per_task),
+    _JC_NUM(45, pn_min_cpus),
+    _JC_NUM(46, pn_min_memory),
+    _JC_NUM(47, shared),
+    _JC_NUM(48, priority),
+    _JC_STR(49, burst_buffer),
+};
+
+#define JOB_CAPTURE_NFIELDS (sizeof(job_capture_fields) / sizeof(job_capture_fields[0]))
+
+/* a growing encode buffer */
+typedef struct job_capture_buf {
+    char* data;
+    size_t len;
+    size_t size;
+} job_capture_buf_t;
+
+static inline void _job_capture_append(job_capture_buf_t* buf, const void* data, size_t len) {
+    if (buf->len + len > buf->size) {
+        buf->size = MAX(buf->size * 2, buf->len + len + 1024);
+        xrealloc(buf->data, buf->size);
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+}
+
+static inline void _job_capture_field(job_capture_buf_t* buf, uint16_t id, const void* data, uint32_t len) {
+    job_capture_field_hdr_t hdr = { id, 0, len };
+    _job_capture_append(buf, &hdr, sizeof(hdr));
+    _job_capture_append(buf, data, len);
+    ((job_capture_rec_hdr_t*)buf->data)->nfields++;
+}
+
+/*
+  starts a record in buf (which is reset), the fields are appended with
+  job_capture_encode() (or _job_capture_field()), and job_capture_end()
+  updates the length
+*/
+static inline void job_capture_begin(job_capture_buf_t* buf, uint16_t type, int64_t time, uint32_t submit_uid) {
+    job_capture_rec_hdr_t hdr = { 0, type, 0, time, submit_uid, 0 };
+    buf->len = 0;
+    _job_capture_append(buf, &hdr, sizeof(hdr));
+}
+
+static inline void job_capture_end(job_capture_buf_t* buf) {
+    ((job_capture_rec_hdr_t*)buf->data)->len = buf->len;
+}
+
+static inline void job_capture_encode(job_capture_buf_t* buf, const job_desc_msg_t* job_desc) {
+    for (size_t i = 0; i < JOB_CAPTURE_NFIELDS; i++) {
+        const job_capture_field_t* field = &job_capture_fields[i];
+        const char* member = (const char*)job_desc + field->offset;
+        switch (field->kind) {
+        case JOB_CAPTURE_NUM:
+            _job_capture_field(buf, field->id, member, field->size);
+            break;
+        case JOB_CAPTURE_STR: {
+            const char* str = *(char* const*)member;
+            if (str)
+                _job_capture_field(buf, field->id, str, strlen(str) + 1);
+            break;
+        }
+        case JOB_CAPTURE_ARRAY: {
+            char* const* array = *(char* const* const*)member;
+            uint32_t count = *(const uint32_t*)((const char*)job_desc + field->count_offset);
+            for (uint32_t j = 0; array && j < count; j++) {
+                if (array[j])
+                    _job_capture_field(buf, field->id, array[j], strlen(array[j]) + 1);
+            }
+            break;
+        }
+        }
+    }
+}
+
+/* returns the field definition of id, NULL if unknown (e.g. a newer writer) */
+static inline const job_capture_field_t* job_capture_field_by_id(uint16_t id) {
+    static const job_capture_field_t* by_id[JOB_CAPTURE_MAX_ID];
+    static bool initialized = false;
+    if (!initialized) {
+        for (size_t i = 0; i < JOB_CAPTURE_NFIELDS; i++)
+            by_id[job_capture_fields[i].id] = &job_capture_fields[i];
+        initialized = true;
+    }
+    return id < JOB_CAPTURE_MAX_ID ? by_id[id] : NULL;
+}
+
+/*
+  fills job_desc (which should be initialized, e.g. with
+  slurm_init_job_desc_msg()) from the fields of the record. Strings are
+  xstrdup()ed, so job_desc can be freed with slurm_free_job_desc_msg().
+  returns false if the record is malformed
+*/
+static inline bool job_capture_decode(const char* rec, const job_capture_rec_hdr_t* rec_hdr, job_desc_msg_t* job_desc) {
+    const char* p = rec + sizeof(job_capture_rec_hdr_t);
+    const char* end = rec + rec_hdr->len;
+    for (uint32_t i = 0; i < rec_hdr->nfields; i++) {
+        job_capture_field_hdr_t hdr;
+        if (end - p < (ptrdiff_t)sizeof(hdr))
+            return false;
+        memcpy(&hdr, p, sizeof(hdr));
+        const char* data = p + sizeof(hdr);
+        if ((size_t)(end - data) < hdr.len)
+            return false;
+        p = data + hdr.len;
+
+        const job_capture_field_t* field = job_capture_field_by_id(hdr.id);
+        if (!field)
+            continue;
+        char* member = (char*)job_desc + field->offset;
+        if (field->kind == JOB_CAPTURE_NUM) {
+            // a different size means a different slurm version, skip it
+            if (hdr.len == field->size)
+                memcpy(member, data, hdr.len);
+            continue;
+        }
+        if (hdr.len == 0 || data[hdr.len - 1] != 0)
+            return false;
+        if (field->kind == JOB_CAPTURE_STR) {
+            xfree(*(char**)member);
+            *(char**)member = xstrdup(data);
+        } else {
+            char*** array = (char***)member;
+            uint32_t* count = (uint32_t*)((char*)job_desc + field->count_offset);
+            xrealloc(*array, (*count + 2) * sizeof(char*));
+            (*array)[(*count)++] = xstrdup(data);
+            (*array)[*count] = NULL;
+        }
+    }
+    return true;
+}
+
+/*
+  returns the next record of the mmap()ed capture at *pos (advancing it) and
+  copies its header to *hdr. NULL at the end or on a truncated record
+*/
+static inline const char* job_capture_next(const char* base, size_t size, size_t* pos, job_capture_rec_hdr_t* hdr) {
+    if (*pos + sizeof(job_capture_rec_hdr_t) > size)
+        return NULL;
+    const char* rec = base + *pos;
+    memcpy(hdr, rec, sizeof(*hdr));
+    if (hdr->len < sizeof(job_capture_rec_hdr_t) || hdr->len > size - *pos)
+        return NULL;
+    *pos += hdr->len;
+    return rec;
+}
+
+#endif
@@ -23,22 +23,171 @@
  *
  *****************************************************************************/
 
+#include <inttypes.h>
+#include <sys/stat.h>
+
 #include <slurm/slurm.h>
 
 #include "src/slurmctld/slurmctld.h"
+#include "src/common/bitstring.h"
+#include "src/common/node_conf.h"
 #include "src/common/xmalloc.h"
 #include "src/common/xstring.h"
 
+#include "feature_expr.h"
+#include "name_index.h"
+
 const char plugin_name[]="cpuonly";
 const char plugin_type[]="job_submit/cpuonly";
 const uint32_t plugin_version = SLURM_VERSION_NUMBER;
 //const uint32_t min_plug_version = 100;
 
+static s_p_options_t cpuonly_options[] = {
+    {"Mode", S_P_STRING},
+    {"PartitionMap", S_P_STRING},
+    {"ShortJobTime", S_P_UINT32},
+    {"GpuNodeReserveCPUs", S_P_UINT32},
+    {"GpuNodeReserveMemory", S_P_UINT64},
+    {"ShortJobFeature", S_P_STRING},
+    {"ShortJobPartition", S_P_STRING},
+    {NULL}
+};
+
+/* how cpu jobs are kept off the gpu nodes */
+typedef enum {
+    MODE_FEATURE,       // add the cpuonly feature
+    MODE_EXCLUDE,       // add the gpu nodes to the excluded nodes
+    MODE_PARTITION,     // replace the partitions by their cpu only partitions
+} cpuonly_mode_t;
+
+static cpuonly_mode_t mode = MODE_FEATURE;
+
+// PartitionMap: partition -> cpu only partition
+static int map_count = 0;
+static char** map_from = NULL;
+static char** map_to = NULL;
+static name_index_t map_index;
+
+// nodes with gpu gres, rebuilt when last_node_update changes
+static bitstr_t* gpu_node_bitmap = NULL;
+static char* gpu_nodes = NULL;
+static time_t gpu_node_update = 0;
+
+// short cpu jobs allowed on the gpu nodes, 0 disables
+static uint32_t short_job_time = 0;             // minutes
+static uint32_t gpu_node_reserve_cpus = 0;      // per node, 0 not checked
+static uint64_t gpu_node_reserve_memory = 0;    // MB per node, 0 not checked
+static char* short_job_feature = NULL;          // OR-ed with cpuonly
+static char* short_job_partition = NULL;        // added to the partitions
+
+/* parses PartitionMap=<partition>:<cpu partition>[,...] */
+static void _parse_partition_map(const char* str) {
+    name_index_init(&map_index, 8);
+    if (!str)
+        return;
+
+    char* tmp_str = xstrdup(str);
+    char* last;
+    char* token = strtok_r(tmp_str, ",", &last);
+    while (token) {
+        char* colon = strchr(token, ':');
+        if (!colon || colon == token || !colon[1])
+            fatal("job_submit/cpuonly: bad PartitionMap entry %s", token);
+        *colon = 0;
+        xrealloc(map_from, (map_count + 1) * sizeof(char*));
+        xrealloc(map_to, (map_count + 1) * sizeof(char*));
+        map_from[map_count] = xstrdup(token);
+        map_to[map_count] = xstrdup(colon + 1);
+        if (name_index_add(&map_index, map_from[map_count], strlen(map_from[map_count]), map_count))
+            map_count++;
+        else
+            fatal("job_submit/cpuonly: partition %s appears more than once in PartitionMap", token);
+        token = strtok_r(NULL, ",", &last);
+    }
+    xfree(tmp_str);
+}
+
 extern int init (void) {
+    char *conf_file = NULL;
+    struct stat config_stat;
+    s_p_hashtbl_t *tbl = NULL;
+    char* mode_str = NULL;
+    char* partition_map = NULL;
+
+    // read conf file, optional
+    conf_file = get_extra_conf_path("cpuonly.conf");
+    if (stat(conf_file, &config_stat) < 0) {
+        info("job_submit/cpuonly: no cpuonly.conf, using Mode=feature");
+        xfree(conf_file);
+        _parse_partition_map(NULL);
+        return SLURM_SUCCESS;
+    }
+
+    tbl = s_p_hashtbl_create(cpuonly_options);
+
+    if (s_p_parse_file(tbl, NULL, conf_file, false) == SLURM_ERROR)
+        fatal("Can't parse cpuonly.conf %s: %m", conf_file);
+
+    s_p_get_string(&mode_str, "Mode", tbl);
+    s_p_get_string(&partition_map, "PartitionMap", tbl);
+
+    if (!mode_str || xstrcasecmp(mode_str, "feature") == 0)
+        mode = MODE_FEATURE;
+    else if (xstrcasecmp(mode_str, "exclude") == 0)
+        mode = MODE_EXCLUDE;
+    else if (xstrcasecmp(mode_str, "partition") == 0)
+        mode = MODE_PARTITION;
+    else
+        fatal("job_submit/cpuonly: unknown Mode %s", mode_str);
+
+    _parse_partition_map(partition_map);
+    if (mode == MODE_PARTITION && map_count == 0)
+        fatal("job_submit/cpuonly: Mode=partition requires PartitionMap");
+
+    s_p_get_uint32(&short_job_time, "ShortJobTime", tbl);
+    s_p_get_uint32(&gpu_node_reserve_cpus, "GpuNodeReserveCPUs", tbl);
+    s_p_get_uint64(&gpu_node_reserve_memory, "GpuNodeReserveMemory", tbl);
+    s_p_get_string(&short_job_feature, "ShortJobFeature", tbl);
+    s_p_get_string(&short_job_partition, "ShortJobPartition", tbl);
+    if (short_job_time) {
+        // the gpu nodes are allowed by the feature in feature mode, and by
+        // the partition in partition mode
+        if (mode == MODE_FEATURE && !short_job_feature)
+            fatal("job_submit/cpuonly: ShortJobTime with Mode=feature requires ShortJobFeature");
+        if (mode == MODE_PARTITION && !short_job_partition)
+            fatal("job_submit/cpuonly: ShortJobTime with Mode=partition requires ShortJobPartition");
+        feature_expr_t* expr = feature_expr_parse(short_job_feature);
+        if (short_job_feature && !expr)
+            fatal("job_submit/cpuonly: bad ShortJobFeature %s", short_job_feature);
+        feature_expr_free(expr);
+    }
+
+    debug("job_submit/cpuonly: Mode=%s PartitionMap=%s", mode_str ? mode_str : "feature", partition_map);
+    debug("job_submit/cpuonly: ShortJobTime=%u GpuNodeReserveCPUs=%u GpuNodeReserveMemory=%"PRIu64" ShortJobFeature=%s ShortJobPartition=%s",
+          short_job_time, gpu_node_reserve_cpus, gpu_node_reserve_memory, short_job_feature, short_job_partition);
+
+    xfree(mode_str);
+    xfree(partition_map);
+    s_p_hashtbl_destroy(tbl);
+    xfree(conf_file);
+
     return SLURM_SUCCESS;
 }
 
 extern int fini (void) {
+    for (int i = 0; i < map_count; i++) {
+        xfree(map_from[i]);
+        xfree(map_to[i]);
+    }
+    xfree(map_from);
+    xfree(map_to);
+    map_count = 0;
+    name_index_free(&map_index);
+    FREE_NULL_BITMAP(gpu_node_bitmap);
+    xfree(gpu_nodes);
+    gpu_node_update = 0;
+    xfree(short_job_feature);
+    xfree(short_job_partition);
     return SLURM_SUCCESS;
 }
 
@@ -60,6 +209,153 @@ inline static bool _has_gpu_gres(const char* gres) {
     return false;
 }
 
+/*
+  rebuild the gpu nodes bitmap if the nodes changed. The node write lock is
+  held on submit, so the node table can be read.
+  last_node_update also changes on node state changes, so the hostlist
+  string is only rebuilt if the gpu nodes actually changed.
+*/
+static void _sync_gpu_nodes(void) {
+    if (gpu_node_bitmap && gpu_node_update == last_node_update)
+        return;
+
+    bitstr_t* bitmap = bit_alloc(node_record_count);
+#if SLURM_VERSION_NUMBER < SLURM_VERSION_NUM(22,5,0)
+    struct node_record* node_ptr = node_record_table_ptr;
+    for (int i = 0; i < node_record_count; i++, node_ptr++) {
+#else
+    node_record_t* node_ptr;
+    for (int i = 0; (node_ptr = next_node(&i)); i++) {
+#endif
+        if (_has_gpu_gres(node_ptr->gres))
+            bit_set(bitmap, i);
+    }
+    gpu_node_update = last_node_update;
+
+    if (gpu_node_bitmap && bit_size(gpu_node_bitmap) == bit_size(bitmap) && bit_equal(gpu_node_bitmap, bitmap)) {
+        FREE_NULL_BITMAP(bitmap);
+        return;
+    }
+
+    FREE_NULL_BITMAP(gpu_node_bitmap);
+    gpu_node_bitmap = bitmap;
+    xfree(gpu_nodes);
+    if (bit_set_count(gpu_node_bitmap))
+        gpu_nodes = bitmap2node_name(gpu_node_bitmap);
+    debug("job_submit/cpuonly: gpu nodes: %s", gpu_nodes);
+}
+
+/* Mode=exclude, adds the gpu nodes to the excluded nodes of the job */
+static void _exclude_gpu_nodes(struct job_descriptor *job_desc) {
+    _sync_gpu_nodes();
+    if (!gpu_nodes)
+        return;
+
+    info("job_submit/cpuonly: excluding gpu nodes");
+    if (job_desc->exc_nodes && *job_desc->exc_nodes)
+        xstrfmtcat(job_desc->exc_nodes, ",%s", gpu_nodes);
+    else {
+        xfree(job_desc->exc_nodes);
+        job_desc->exc_nodes = xstrdup(gpu_nodes);
+    }
+}
+
+/* Mode=partition, replaces the job's partitions with their PartitionMap */
+static void _map_partitions(struct job_descriptor *job_desc) {
+    const char* partitions = job_desc->partition ? job_desc->partition : default_part_name;
+    char* mapped = NULL;
+    bool changed = false;
+
+    if (!partitions)
+        return;
+
+    for (const char* p = partitions; *p; ) {
+        size_t len = strcspn(p, ",");
+        int i = len ? name_index_get(&map_index, p, len) : -1;
+        if (len) {
+            if (mapped)
+                xstrcat(mapped, ",");
+            if (i >= 0) {
+                xstrcat(mapped, map_to[i]);
+                changed = true;
+            } else {
+                xstrncat(mapped, p, len);
+            }
+        }
+        p += len;
+        if (*p)
+            p++;
+    }
+
+    if (changed) {
+        info("job_submit/cpuonly: partitions %s -> %s", partitions, mapped);
+        xfree(job_desc->partition);
+        job_desc->partition = mapped;
+    } else {
+        xfree(mapped);
+    }
+}
+
+/*
+  checks if the job can backfill the gpu nodes: an explicit time limit up to
+  short_job_time, and cpus and memory per node within the gpu node reserve
+*/
+static bool _short_job(struct job_descriptor *job_desc) {
+    if (!short_job_time)
+        return false;
+    // no time limit means the partition default, which isn't known here
+    if (job_desc->time_limit == NO_VAL || job_desc->time_limit == INFINITE ||
+        job_desc->time_limit > short_job_time)
+        return false;
+
+    uint32_t nodes = (job_desc->min_nodes != NO_VAL && job_desc->min_nodes) ? job_desc->min_nodes : 1;
+    uint32_t cpus = 1;
+    if (job_desc->min_cpus != NO_VAL && job_desc->min_cpus > cpus)
+        cpus = job_desc->min_cpus;
+    if (job_desc->num_tasks != NO_VAL && job_desc->cpus_per_task != NO_VAL16 &&
+        job_desc->num_tasks * job_desc->cpus_per_task > cpus)
+        cpus = job_desc->num_tasks * job_desc->cpus_per_task;
+    uint32_t cpus_per_node = (cpus + nodes - 1) / nodes;
+    if (job_desc->pn_min_cpus != NO_VAL16 && job_desc->pn_min_cpus > cpus_per_node)
+        cpus_per_node = job_desc->pn_min_cpus;
+    if (gpu_node_reserve_cpus && cpus_per_node > gpu_node_reserve_cpus)
+        return false;
+
+    if (gpu_node_reserve_memory) {
+        // no memory request means the partition default
+        if (job_desc->pn_min_memory == NO_VAL64)
+            return false;
+        uint64_t memory = job_desc->pn_min_memory;
+        if (memory & MEM_PER_CPU)
+            memory = (memory & ~MEM_PER_CPU) * cpus_per_node;
+        if (memory > gpu_node_reserve_memory)
+            return false;
+    }
+
+    return true;
+}
+
+/* adds short_job_partition to the job's partitions (or the default one) */
+static void _add_short_partition(struct job_descriptor *job_desc) {
+    const char* partitions = job_desc->partition ? job_desc->partition : default_part_name;
+    size_t len = strlen(short_job_partition);
+
+    for (const char* p = partitions; p && *p; ) {
+        size_t plen = strcspn(p, ",");
+        if (plen == len && strncmp(p, short_job_partition, len) == 0)
+            return;
+        p += plen;
+        if (*p)
+            p++;
+    }
+
+    char* tmp_str = (partitions && *partitions) ?
+        xstrdup_printf("%s,%s", partitions, short_job_partition) : xstrdup(short_job_partition);
+    debug("job_submit/cpuonly: short job, partitions %s", tmp_str);
+    xfree(job_desc->partition);
+    job_desc->partition = tmp_str;
+}
+
 extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid, char **err_msg) {
 
     bool wants_gpu = false;
@@ -77,28 +373,70 @@ extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid, char
         return SLURM_SUCCESS;
     }
 
-    if (job_desc->features) {
-        // I'm not going to check the entire syntax with ORs, ANDs, and
-        // parenthesis...
-        if (strcmp(job_desc->features, "cpuonly") == 0) {
-            wants_cpuonly = true;
+    // short jobs may also use the gpu nodes (see ShortJobTime)
+    bool short_job = _short_job(job_desc);
+    if (short_job)
+        info("job_submit/cpuonly: short job, allowing gpu nodes");
+
+    if (mode == MODE_PARTITION) {
+        _map_partitions(job_desc);
+        if (short_job)
+            _add_short_partition(job_desc);
+        return SLURM_SUCCESS;
+    }
+    if (short_job && short_job_partition)
+        _add_short_partition(job_desc);
+
+    feature_expr_t* expr = feature_expr_parse(job_desc->features);
+    if (job_desc->features && *job_desc->features && !expr) {
+        // not something we understand, wrap it as is (unless already done)
+        if (mode == MODE_EXCLUDE) {
+            if (!short_job)
+                _exclude_gpu_nodes(job_desc);
+        } else if (strncmp(job_desc->features, "cpuonly&(", 9) != 0) {
+            info("job_submit/cpuonly: can't parse features, adding cpuonly");
+            char* tmp_str = xstrdup_printf("cpuonly&(%s)", job_desc->features);
+            xfree(job_desc->features);
+            job_desc->features = tmp_str;
         }
+        return SLURM_SUCCESS;
+    }
+
+    if (expr && feature_expr_requires(expr, "cpuonly")) {
+        wants_cpuonly = true;
     }
 
     debug("job_submit/cpuonly: %s cpuonly", (wants_cpuonly ? "wants" : "probably didn't want"));
 
+    if (mode == MODE_EXCLUDE) {
+        // the features are left as is, only the nodes are excluded
+        if (!wants_cpuonly && !short_job)
+            _exclude_gpu_nodes(job_desc);
+        feature_expr_free(expr);
+        return SLURM_SUCCESS;
+    }
+
     if (!wants_cpuonly) {
         info("job_submit/cpuonly: adding cpuonly");
-        if (job_desc->features) {
-            char* tmp_str = xmalloc(strlen(job_desc->features) + strlen("cpuonly&()") + 1);
-            strcpy(tmp_str, "cpuonly&(");
-            strcat(tmp_str, job_desc->features);
-            strcat(tmp_str, ")");
-            xfree(job_desc->features);
-            job_desc->features = tmp_str;
-        } else {
-            job_desc->features = xstrdup("cpuonly");
+        feature_expr_t* cpuonly = feature_expr_leaf("cpuonly", strlen("cpuonly"), 0);
+        if (short_job) {
+            // cpuonly|<ShortJobFeature>
+            cpuonly = feature_expr_op(FEATURE_OR, cpuonly, feature_expr_parse(short_job_feature));
         }
+        expr = expr ? feature_expr_op(FEATURE_AND, cpuonly, expr) : cpuonly;
+    }
+
+    // also cleans up previously rewritten features (e.g. requeued jobs with
+    // cpuonly&(cpuonly&(...)))
+    expr = feature_expr_normalize(expr);
+    char* features = feature_expr_write(expr);
+    feature_expr_free(expr);
+    if (xstrcmp(features, job_desc->features) != 0) {
+        debug("job_submit/cpuonly: features %s -> %s", job_desc->features, features);
+        xfree(job_desc->features);
+        job_desc->features = features;
+    } else {
+        xfree(features);
     }
 
     return SLURM_SUCCESS;
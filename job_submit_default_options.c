@@ -31,25 +31,203 @@
 
 #include "src/slurmctld/slurmctld.h"
 
+#include "src/common/assoc_mgr.h"
+#include "src/common/parse_time.h"
+#include "src/common/proc_args.h"
 #include "src/common/xstring.h"
 
+#include "name_index.h"
+
 const char plugin_name[]="Set default options for jobs";
 const char plugin_type[]="job_submit/default_options";
 const uint32_t plugin_version = SLURM_VERSION_NUMBER;
 //const uint32_t min_plug_version = 100;
 
+/*
+  Defaults lines are rules keyed by User, Account and Partition, each of which
+  can be "*" (or omitted) for any. The rules are compiled at init() into a
+  name_index by "<user>\x1f<account>\x1f<partition>" (with "*" for the
+  wildcards), and on submit each combination of keys is probed from the most
+  specific, filling the unset fields of the job, until all of them are set.
+
+  The precedence is by the number of keys, and then user over account over
+  partition, see key_order.
+*/
+
+s_p_options_t defaults_options[] = {
+	{"Defaults", S_P_STRING},
+	{"User", S_P_STRING},
+	{"Account", S_P_STRING},
+	{"Partition", S_P_STRING},
+	{"QOS", S_P_STRING},
+	{"TimeLimit", S_P_STRING},
+	{"TimeMin", S_P_STRING},
+	{"Features", S_P_STRING},
+	{"ClusterFeatures", S_P_STRING},
+	{"MailType", S_P_STRING},
+	{NULL}
+};
+
 static s_p_options_t default_options_options[] = {
 	{"cluster_features", S_P_STRING},
+	{"Defaults", S_P_LINE, NULL, NULL, defaults_options},
 	{NULL}
 };
 
+// the keys of a rule (bit mask of the non wildcard ones)
+#define KEY_PARTITION 1
+#define KEY_ACCOUNT 2
+#define KEY_USER 4
+
+// from the most specific
+static const int key_order[] = {
+    KEY_USER | KEY_ACCOUNT | KEY_PARTITION,
+    KEY_USER | KEY_ACCOUNT,
+    KEY_USER | KEY_PARTITION,
+    KEY_ACCOUNT | KEY_PARTITION,
+    KEY_USER,
+    KEY_ACCOUNT,
+    KEY_PARTITION,
+    0
+};
+
+// the rules_keys bits of the key combinations with a user / account / partition
+#define WITH_USER 0xf0
+#define WITH_ACCOUNT 0xcc
+#define WITH_PARTITION 0xaa
+
+#define KEY_SEP '\x1f'
+
+// the fields a rule can set
+#define FIELD_QOS 1
+#define FIELD_TIME_LIMIT 2
+#define FIELD_TIME_MIN 4
+#define FIELD_FEATURES 8
+#define FIELD_CLUSTER_FEATURES 16
+#define FIELD_MAIL_TYPE 32
+
+typedef struct default_rule {
+    char* name;         // the Defaults value, for the logs
+    char* key;          // the rules_index key
+    int fields;         // FIELD_* set by the rule
+    char* qos;
+    uint32_t time_limit;
+    uint32_t time_min;
+    char* features;
+    char* cluster_features;
+    uint16_t mail_type;
+} default_rule_t;
+
 char* cluster_features = NULL;
 
+static default_rule_t* rules = NULL;
+static int rules_count = 0;
+static name_index_t rules_index;
+static int rules_keys = 0;      // bit i set if there are rules with the keys i
+
+static uint32_t _parse_time(const char* rule, const char* option, const char* value) {
+    uint32_t mins = time_str2mins(value);
+    if (mins == NO_VAL || ((int)mins < 0 && mins != INFINITE))
+        fatal("job_submit/default_options: Defaults=%s: invalid %s %s", rule, option, value);
+    return mins;
+}
+
+inline static bool _wildcard(const char* key) {
+    return !key || strcmp(key, "*") == 0;
+}
+
+/* sets the fields of the Defaults line in rule (overriding earlier lines) */
+static void _set_rule(default_rule_t* rule, const char* name, s_p_hashtbl_t* line) {
+    char* value = NULL;
+    if (s_p_get_string(&value, "QOS", line)) {
+        xfree(rule->qos);
+        rule->qos = value;
+        rule->fields |= FIELD_QOS;
+    }
+    if (s_p_get_string(&value, "TimeLimit", line)) {
+        rule->time_limit = _parse_time(name, "TimeLimit", value);
+        rule->fields |= FIELD_TIME_LIMIT;
+        xfree(value);
+    }
+    if (s_p_get_string(&value, "TimeMin", line)) {
+        rule->time_min = _parse_time(name, "TimeMin", value);
+        rule->fields |= FIELD_TIME_MIN;
+        xfree(value);
+    }
+    if (s_p_get_string(&value, "Features", line)) {
+        xfree(rule->features);
+        rule->features = value;
+        rule->fields |= FIELD_FEATURES;
+    }
+    if (s_p_get_string(&value, "ClusterFeatures", line)) {
+        xfree(rule->cluster_features);
+        rule->cluster_features = value;
+        rule->fields |= FIELD_CLUSTER_FEATURES;
+    }
+    if (s_p_get_string(&value, "MailType", line)) {
+        rule->mail_type = parse_mail_type(value);
+        if (rule->mail_type == 0 || rule->mail_type == INFINITE16)
+            fatal("job_submit/default_options: Defaults=%s: invalid MailType %s", name, value);
+        rule->fields |= FIELD_MAIL_TYPE;
+        xfree(value);
+    }
+}
+
+static void _compile_rules(s_p_hashtbl_t** lines, int count) {
+    rules = xmalloc((count + 1) * sizeof(default_rule_t));
+    rules_count = 0;
+    rules_keys = 0;
+    name_index_init(&rules_index, count);
+
+    for (int i = 0; i < count; i++) {
+        char* name = NULL;
+        char* user = NULL;
+        char* account = NULL;
+        char* partition = NULL;
+        int keys = 0;
+
+        s_p_get_string(&name, "Defaults", lines[i]);
+        s_p_get_string(&user, "User", lines[i]);
+        s_p_get_string(&account, "Account", lines[i]);
+        s_p_get_string(&partition, "Partition", lines[i]);
+        keys |= _wildcard(user) ? 0 : KEY_USER;
+        keys |= _wildcard(account) ? 0 : KEY_ACCOUNT;
+        keys |= _wildcard(partition) ? 0 : KEY_PARTITION;
+        char* key = xstrdup_printf("%s%c%s%c%s",
+                                   keys & KEY_USER ? user : "*", KEY_SEP,
+                                   keys & KEY_ACCOUNT ? account : "*", KEY_SEP,
+                                   keys & KEY_PARTITION ? partition : "*");
+        xfree(user);
+        xfree(account);
+        xfree(partition);
+
+        // lines with the same keys are merged
+        int r = name_index_get(&rules_index, key, strlen(key));
+        if (r >= 0) {
+            debug("job_submit/default_options: Defaults=%s has the same keys as Defaults=%s, merged", name, rules[r].name);
+            _set_rule(&rules[r], name, lines[i]);
+            xfree(name);
+            xfree(key);
+            continue;
+        }
+        r = rules_count++;
+        rules[r].name = name;
+        rules[r].key = key;
+        rules[r].time_limit = NO_VAL;
+        rules[r].time_min = NO_VAL;
+        _set_rule(&rules[r], name, lines[i]);
+        name_index_add(&rules_index, key, strlen(key), r);
+        rules_keys |= 1 << keys;
+    }
+}
+
 extern int init (void) {
 
     char *conf_file = NULL;
     struct stat config_stat;
     s_p_hashtbl_t *tbl = NULL;
+    s_p_hashtbl_t **lines = NULL;
+    int count = 0;
 
     // read conf file
     conf_file = get_extra_conf_path("default_options.conf");
@@ -62,6 +240,8 @@ extern int init (void) {
         fatal("Can't parse default_options.conf %s: %m", conf_file);
 
     s_p_get_string(&cluster_features, "cluster_features", tbl);
+    s_p_get_line(&lines, &count, "Defaults", tbl);
+    _compile_rules(lines, count);
 
     s_p_hashtbl_destroy(tbl);
     xfree(conf_file);
@@ -69,16 +249,126 @@ extern int init (void) {
     // validate
     // FIXME, validate cluster_features is a/are real features
 
+    info("job_submit/default_options: %i defaults rules", rules_count);
+
     return SLURM_SUCCESS;
 }
 
 extern int fini (void) {
     xfree(cluster_features);
     cluster_features = NULL;
+    for (int i = 0; i < rules_count; i++) {
+        xfree(rules[i].name);
+        xfree(rules[i].key);
+        xfree(rules[i].qos);
+        xfree(rules[i].features);
+        xfree(rules[i].cluster_features);
+    }
+    xfree(rules);
+    rules_count = 0;
+    rules_keys = 0;
+    name_index_free(&rules_index);
     return SLURM_SUCCESS;
 }
 
+/* the fields of the job which aren't set yet */
+static int _unset_fields(const struct job_descriptor *job_desc) {
+    int fields = 0;
+    fields |= job_desc->qos ? 0 : FIELD_QOS;
+    fields |= job_desc->time_limit == NO_VAL ? FIELD_TIME_LIMIT : 0;
+    fields |= job_desc->time_min == NO_VAL ? FIELD_TIME_MIN : 0;
+    fields |= job_desc->features ? 0 : FIELD_FEATURES;
+    fields |= job_desc->cluster_features ? 0 : FIELD_CLUSTER_FEATURES;
+    fields |= (job_desc->mail_type == 0 || job_desc->mail_type == NO_VAL16) ? FIELD_MAIL_TYPE : 0;
+    return fields;
+}
+
+/* sets the unset fields of the job from rule, returns the fields set */
+static int _apply_rule(struct job_descriptor *job_desc, const default_rule_t* rule, int fields) {
+    fields &= rule->fields;
+    if (!fields)
+        return 0;
+    if (fields & FIELD_QOS)
+        job_desc->qos = xstrdup(rule->qos);
+    if (fields & FIELD_TIME_LIMIT)
+        job_desc->time_limit = rule->time_limit;
+    if (fields & FIELD_TIME_MIN)
+        job_desc->time_min = rule->time_min;
+    if (fields & FIELD_FEATURES)
+        job_desc->features = xstrdup(rule->features);
+    if (fields & FIELD_CLUSTER_FEATURES)
+        job_desc->cluster_features = xstrdup(rule->cluster_features);
+    if (fields & FIELD_MAIL_TYPE)
+        job_desc->mail_type = rule->mail_type;
+    debug("job_submit/default_options: Defaults=%s for uid %u (fields 0x%x)", rule->name, job_desc->user_id, fields);
+    return fields;
+}
+
+/*
+  returns the rule with the keys, -1 if none. The first partition (of a
+  comma separated list) with a rule is used
+*/
+static int _find_rule(int keys, const char* user, const char* account, const char* partitions) {
+    char key[1024];
+    const char* p = (keys & KEY_PARTITION) && partitions ? partitions : "*";
+    do {
+        size_t len = (keys & KEY_PARTITION) ? strcspn(p, ",") : 1;
+        int n = snprintf(key, sizeof(key), "%s%c%s%c%.*s",
+                         (keys & KEY_USER) ? user : "*", KEY_SEP,
+                         (keys & KEY_ACCOUNT) ? account : "*", KEY_SEP,
+                         (int)len, (keys & KEY_PARTITION) ? p : "*");
+        if (n > 0 && (size_t)n < sizeof(key)) {
+            int r = name_index_get(&rules_index, key, n);
+            if (r >= 0)
+                return r;
+        }
+        p += len;
+    } while ((keys & KEY_PARTITION) && *p++);
+    return -1;
+}
+
 extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid, char **err_msg) {
+    int fields = _unset_fields(job_desc);
+
+    if (rules_count && fields) {
+        slurmdb_user_rec_t user;
+        const char* account = job_desc->account;
+        const char* partitions = job_desc->partition ? job_desc->partition : default_part_name;
+        int needed = rules_keys;
+
+        // the user record is needed only for rules with users, or with
+        // accounts for jobs without one
+        memset(&user, 0, sizeof(slurmdb_user_rec_t));
+        user.uid = job_desc->user_id;
+        if (rules_keys & WITH_USER || (!account && rules_keys & WITH_ACCOUNT)) {
+#if SLURM_VERSION_NUMBER < SLURM_VERSION_NUM(19,5,0)
+            if (assoc_mgr_fill_in_user(acct_db_conn, &user, accounting_enforce, NULL) == SLURM_ERROR) {
+#else
+            if (assoc_mgr_fill_in_user(acct_db_conn, &user, accounting_enforce, NULL, false) == SLURM_ERROR) {
+#endif
+                debug("job_submit/default_options: can't get user %u, skipping user and account rules", job_desc->user_id);
+                needed &= ~(WITH_USER | WITH_ACCOUNT);
+            } else if (!account) {
+                account = user.default_acct;
+            }
+        }
+        if (!user.name)
+            needed &= ~WITH_USER;
+        if (!account)
+            needed &= ~WITH_ACCOUNT;
+        if (!partitions)
+            needed &= ~WITH_PARTITION;
+
+        for (int i = 0; i < (int)(sizeof(key_order) / sizeof(key_order[0])) && fields; i++) {
+            int keys = key_order[i];
+            if (!(needed & (1 << keys)))
+                continue;
+            int r = _find_rule(keys, user.name, account, partitions);
+            if (r >= 0)
+                fields &= ~_apply_rule(job_desc, &rules[r], fields);
+        }
+    }
+
     if (cluster_features != NULL && job_desc->cluster_features == NULL) {
         info("default_options: cluster_features = %s", cluster_features);
         job_desc->cluster_features = xstrdup(cluster_features);
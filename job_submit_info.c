@@ -28,146 +28,741 @@
 
 #include "src/slurmctld/slurmctld.h"
 #include "src/common/assoc_mgr.h"
-
+#include "src/common/uid.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <time.h>
+#include <unistd.h>
+
+#include "job_capture.h"
 
 const char plugin_name[]="some job info";
 const char plugin_type[]="job_submit/info";
 const uint32_t plugin_version = SLURM_VERSION_NUMBER;
 //const uint32_t min_plug_version = 100;
 
+/*
+  The job info is formatted into a record, which is copied into an in memory
+  ring buffer. A writer thread writes the records to the log file in batches
+  (writev), and rotates it. Submissions never wait for the disk: when the
+  buffer is full the record is dropped and counted.
+
+  Ring buffer: head and tail are byte positions which only grow (modulo the
+  buffer size, a power of 2). Producers reserve space by a CAS on head, copy
+  the record after a record_hdr_t, and then set its ready flag. The writer
+  consumes ready records from tail, zeroes them (so a header of a future
+  record is never seen as ready), and advances tail. Records are 8 bytes
+  aligned, so a header never wraps.
+
+  Size stats: the sizes of the script, environment and argv of each job are
+  counted per user in log2 histograms, which the writer thread dumps to
+  SizeStatsFile every SizeStatsInterval seconds. The same sizes are checked
+  against the Max* limits, which reject the job, or with OversizeAction=strip
+  remove the environment variables longer than MaxEnvVarSize.
+*/
+
+static s_p_options_t info_options[] = {
+    {"LogFile", S_P_STRING},
+    {"BufferSize", S_P_UINT32},
+    {"MaxRecordSize", S_P_UINT32},
+    {"MaxLogSize", S_P_UINT64},
+    {"LogFiles", S_P_UINT32},
+    {"FlushInterval", S_P_UINT32},
+    {"Format", S_P_STRING},
+    {"SizeStats", S_P_BOOLEAN},
+    {"SizeStatsFile", S_P_STRING},
+    {"SizeStatsInterval", S_P_UINT32},
+    {"MaxScriptSize", S_P_UINT64},
+    {"MaxEnvSize", S_P_UINT64},
+    {"MaxEnvCount", S_P_UINT32},
+    {"MaxEnvVarSize", S_P_UINT64},
+    {"MaxArgvSize", S_P_UINT64},
+    {"OversizeAction", S_P_STRING},
+    {NULL}
+};
+
+static char* log_file = NULL;
+static uint32_t buffer_size = 4 * 1024 * 1024;
+static uint32_t max_record_size = 64 * 1024;
+static uint64_t max_log_size = 100 * 1024 * 1024;  // 0 never rotates
+static uint32_t log_files = 5;                      // rotated files kept
+static uint32_t flush_interval = 200;               // ms
+static bool binary_format = false;                  // job_capture.h records
+static bool size_stats = false;
+static char* size_stats_file = NULL;
+static uint32_t size_stats_interval = 300;          // seconds
+static uint64_t max_script_size = 0;                // 0 is no limit
+static uint64_t max_env_size = 0;
+static uint32_t max_env_count = 0;
+static uint64_t max_env_var_size = 0;
+static uint64_t max_argv_size = 0;
+static bool oversize_strip = false;                 // otherwise reject
+
+typedef struct record_hdr {
+    uint32_t len;       // of the record, without the header and padding
+    uint32_t ready;
+} record_hdr_t;
+
+#define RECORD_ALIGN 8
+#define RECORD_SPACE(len) ((sizeof(record_hdr_t) + (len) + RECORD_ALIGN - 1) & ~(uint64_t)(RECORD_ALIGN - 1))
+
+static char* ring = NULL;
+static uint64_t ring_mask = 0;
+static uint64_t ring_head = 0;      // next reservation
+static uint64_t ring_tail = 0;      // next record to write
+static uint64_t dropped = 0;
+static uint64_t sequence = 0;
+
+typedef enum {
+    SIZE_SCRIPT,
+    SIZE_ENV,
+    SIZE_ENV_COUNT,
+    SIZE_ARGV,
+    SIZE_STATS
+} size_stat_t;
+
+static const char* size_stat_names[SIZE_STATS] = { "script_bytes", "env_bytes", "env_count", "argv_bytes" };
+
+// bucket 0 is 0, bucket i is [2^(i-1), 2^i), the last one is everything above
+#define SIZE_BUCKETS 33
+
+typedef struct user_sizes {
+    uint32_t uid;
+    bool used;
+    uint64_t jobs;
+    uint64_t rejected;
+    uint64_t stripped;
+    uint64_t sum[SIZE_STATS];
+    uint64_t max[SIZE_STATS];
+    uint64_t hist[SIZE_STATS][SIZE_BUCKETS];
+} user_sizes_t;
+
+// open addressing by uid, guarded by sizes_lock (the writer thread dumps it)
+static pthread_mutex_t sizes_lock = PTHREAD_MUTEX_INITIALIZER;
+static user_sizes_t* user_sizes = NULL;
+static uint32_t user_sizes_size = 0;
+static uint32_t user_sizes_count = 0;
+static time_t sizes_start = 0;
+static time_t sizes_next_dump = 0;
+
+static pthread_t writer_thread;
+static bool writer_running = false;
+static bool writer_stop = false;
+static int log_fd = -1;
+static uint64_t log_size = 0;
+
+/* a record being formatted */
+typedef struct rec {
+    char* data;
+    size_t len;
+    size_t size;
+    bool truncated;
+} rec_t;
+
+static const char* _str(const char* str) {
+    return str ? str : "(null)";
+}
+
+/* appends to the record, up to max_record_size */
+static void _rec_printf(rec_t* rec, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+static void _rec_printf(rec_t* rec, const char* fmt, ...) {
+    va_list ap;
+    if (rec->truncated)
+        return;
+    for (;;) {
+        size_t avail = rec->size - rec->len;
+        va_start(ap, fmt);
+        int n = vsnprintf(rec->data + rec->len, avail, fmt, ap);
+        va_end(ap);
+        if (n < 0)
+            return;
+        if ((size_t)n < avail) {
+            rec->len += n;
+            break;
+        }
+        if (rec->size >= max_record_size) {
+            static const char mark[] = "...(truncated)\n";
+            rec->len = rec->size - sizeof(mark);
+            memcpy(rec->data + rec->len, mark, sizeof(mark));
+            rec->len += sizeof(mark) - 1;
+            rec->truncated = true;
+            return;
+        }
+        rec->size = MIN(MAX(rec->size * 2, rec->len + n + 1), max_record_size);
+        xrealloc(rec->data, rec->size);
+    }
+}
+
+/* copies the record into the ring buffer, false if there's no room */
+static bool _ring_push(const char* data, uint32_t len) {
+    uint64_t space = RECORD_SPACE(len);
+    uint64_t head = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+    do {
+        uint64_t tail = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+        if (head + space - tail > ring_mask + 1)
+            return false;
+    } while (!__atomic_compare_exchange_n(&ring_head, &head, head + space, true,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+
+    record_hdr_t* hdr = (record_hdr_t*)(ring + (head & ring_mask));
+    uint64_t start = (head + sizeof(record_hdr_t)) & ring_mask;
+    uint64_t first = MIN((uint64_t)len, ring_mask + 1 - start);
+    memcpy(ring + start, data, first);
+    memcpy(ring, data + first, len - first);
+    hdr->len = len;
+    __atomic_store_n(&hdr->ready, 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/* opens log_file, rotating it first if rotate */
+static void _open_log(bool rotate) {
+    if (log_fd >= 0) {
+        close(log_fd);
+        log_fd = -1;
+    }
+    if (rotate && log_files) {
+        char from[PATH_MAX];
+        char to[PATH_MAX];
+        for (uint32_t i = log_files; i > 1; i--) {
+            snprintf(from, sizeof(from), "%s.%u", log_file, i - 1);
+            snprintf(to, sizeof(to), "%s.%u", log_file, i);
+            rename(from, to);
+        }
+        snprintf(to, sizeof(to), "%s.1", log_file);
+        rename(log_file, to);
+    } else if (rotate) {
+        unlink(log_file);
+    }
+
+    log_fd = open(log_file, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (log_fd < 0) {
+        error("job_submit/info: can't open %s: %m", log_file);
+        return;
+    }
+    struct stat st;
+    log_size = (fstat(log_fd, &st) == 0) ? st.st_size : 0;
+
+    if (binary_format && log_size == 0) {
+        job_capture_file_hdr_t hdr = { JOB_CAPTURE_MAGIC, JOB_CAPTURE_VERSION, SLURM_VERSION_NUMBER };
+        if (write(log_fd, &hdr, sizeof(hdr)) == sizeof(hdr))
+            log_size = sizeof(hdr);
+        else
+            error("job_submit/info: can't write to %s: %m", log_file);
+    }
+}
+
+static void _write_iov(struct iovec* iov, int count, size_t bytes) {
+    if (count == 0)
+        return;
+    if (log_fd < 0)
+        _open_log(false);
+    if (log_fd >= 0 && writev(log_fd, iov, count) < 0)
+        error("job_submit/info: can't write to %s: %m", log_file);
+    log_size += bytes;
+}
+
+/* writes the ready records, returns the number of bytes consumed */
+static uint64_t _drain(void) {
+    struct iovec iov[64];
+    int count = 0;
+    size_t bytes = 0;
+    uint64_t tail = __atomic_load_n(&ring_tail, __ATOMIC_RELAXED);
+    uint64_t pos = tail;
+    char drops[64];
+    job_capture_buf_t drops_rec = { NULL, 0, 0 };
+
+    uint64_t n_dropped = __atomic_exchange_n(&dropped, 0, __ATOMIC_RELAXED);
+    if (n_dropped && binary_format) {
+        job_capture_begin(&drops_rec, JOB_CAPTURE_DROPPED, time(NULL), 0);
+        _job_capture_field(&drops_rec, 0, &n_dropped, sizeof(n_dropped));
+        job_capture_end(&drops_rec);
+        iov[count].iov_base = drops_rec.data;
+        iov[count].iov_len = drops_rec.len;
+        bytes += iov[count++].iov_len;
+    } else if (n_dropped) {
+        iov[count].iov_base = drops;
+        iov[count].iov_len = snprintf(drops, sizeof(drops), "=== dropped %"PRIu64" records\n", n_dropped);
+        bytes += iov[count++].iov_len;
+    }
+
+    // a record takes up to 2 iovecs (when it wraps)
+    while (count <= (int)(sizeof(iov) / sizeof(iov[0])) - 2) {
+        record_hdr_t* hdr = (record_hdr_t*)(ring + (pos & ring_mask));
+        if (!__atomic_load_n(&hdr->ready, __ATOMIC_ACQUIRE))
+            break;
+        uint64_t start = (pos + sizeof(record_hdr_t)) & ring_mask;
+        uint64_t first = MIN((uint64_t)hdr->len, ring_mask + 1 - start);
+        iov[count].iov_base = ring + start;
+        iov[count++].iov_len = first;
+        if (hdr->len > first) {
+            iov[count].iov_base = ring;
+            iov[count++].iov_len = hdr->len - first;
+        }
+        bytes += hdr->len;
+        pos += RECORD_SPACE(hdr->len);
+    }
+
+    _write_iov(iov, count, bytes);
+    xfree(drops_rec.data);
+    if (pos == tail)
+        return 0;
+
+    // zero the consumed space before releasing it
+    uint64_t start = tail & ring_mask;
+    uint64_t first = MIN(pos - tail, ring_mask + 1 - start);
+    memset(ring + start, 0, first);
+    memset(ring, 0, pos - tail - first);
+    __atomic_store_n(&ring_tail, pos, __ATOMIC_RELEASE);
+
+    if (max_log_size && log_size >= max_log_size)
+        _open_log(true);
+    return pos - tail;
+}
+
+static inline uint32_t _uid_slot(uint32_t uid, uint32_t size) {
+    return (uid * 2654435761u) & (size - 1);
+}
+
+/* the stats of uid, added if needed. sizes_lock should be held */
+static user_sizes_t* _user_sizes(uint32_t uid) {
+    uint32_t i;
+    if ((user_sizes_count + 1) * 2 > user_sizes_size) {
+        uint32_t size = user_sizes_size ? user_sizes_size * 2 : 64;
+        user_sizes_t* table = xmalloc(size * sizeof(user_sizes_t));
+        for (uint32_t j = 0; j < user_sizes_size; j++) {
+            if (!user_sizes[j].used)
+                continue;
+            for (i = _uid_slot(user_sizes[j].uid, size); table[i].used; i = (i + 1) & (size - 1))
+                ;
+            table[i] = user_sizes[j];
+        }
+        xfree(user_sizes);
+        user_sizes = table;
+        user_sizes_size = size;
+    }
+    for (i = _uid_slot(uid, user_sizes_size); user_sizes[i].used; i = (i + 1) & (user_sizes_size - 1)) {
+        if (user_sizes[i].uid == uid)
+            return &user_sizes[i];
+    }
+    user_sizes[i].used = true;
+    user_sizes[i].uid = uid;
+    user_sizes_count++;
+    return &user_sizes[i];
+}
+
+static inline int _size_bucket(uint64_t size) {
+    return size ? MIN(64 - __builtin_clzll(size), SIZE_BUCKETS - 1) : 0;
+}
+
+static void _count_sizes(uint32_t uid, const uint64_t sizes[SIZE_STATS], bool rejected, bool stripped) {
+    pthread_mutex_lock(&sizes_lock);
+    user_sizes_t* user = _user_sizes(uid);
+    user->jobs++;
+    user->rejected += rejected;
+    user->stripped += stripped;
+    for (int i = 0; i < SIZE_STATS; i++) {
+        user->sum[i] += sizes[i];
+        user->max[i] = MAX(user->max[i], sizes[i]);
+        user->hist[i][_size_bucket(sizes[i])]++;
+    }
+    pthread_mutex_unlock(&sizes_lock);
+}
+
+/* formats size with a K/M/G suffix (e.g. 1.5M) */
+static const char* _human(uint64_t size, char* buf, size_t len) {
+    static const char units[] = "KMGT";
+    double value = size;
+    int unit = -1;
+    while (value >= 1024 && unit < (int)sizeof(units) - 2) {
+        value /= 1024;
+        unit++;
+    }
+    if (unit < 0)
+        snprintf(buf, len, "%"PRIu64, size);
+    else
+        snprintf(buf, len, "%.*f%c", value < 10 && value != (uint64_t)value ? 1 : 0, value, units[unit]);
+    return buf;
+}
+
+static int _uid_cmp(const void* a, const void* b) {
+    uint32_t x = ((const user_sizes_t*)a)->uid;
+    uint32_t y = ((const user_sizes_t*)b)->uid;
+    return (x > y) - (x < y);
+}
+
+/*
+  writes the size stats to size_stats_file (replacing it). The table is copied
+  under the lock, so submissions don't wait for the disk or the user lookups
+*/
+static void _dump_sizes(void) {
+    char tmp[PATH_MAX];
+    char bound[32];
+    uint32_t count = 0;
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&sizes_lock);
+    user_sizes_t* users = xmalloc(MAX(user_sizes_count, 1) * sizeof(user_sizes_t));
+    for (uint32_t i = 0; i < user_sizes_size; i++) {
+        if (user_sizes[i].used)
+            users[count++] = user_sizes[i];
+    }
+    pthread_mutex_unlock(&sizes_lock);
+    qsort(users, count, sizeof(user_sizes_t), _uid_cmp);
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", size_stats_file);
+    FILE* out = fopen(tmp, "w");
+    if (!out) {
+        error("job_submit/info: can't write %s: %m", tmp);
+        xfree(users);
+        return;
+    }
+    fprintf(out, "=== sizes from %ld to %ld\n", (long)sizes_start, (long)now);
+    for (uint32_t i = 0; i < count; i++) {
+        char* name = uid_to_string((uid_t)users[i].uid);
+        fprintf(out, "user %s uid %u jobs %"PRIu64" rejected %"PRIu64" stripped %"PRIu64"\n",
+                name, users[i].uid, users[i].jobs, users[i].rejected, users[i].stripped);
+        xfree(name);
+        for (int j = 0; j < SIZE_STATS; j++) {
+            fprintf(out, "  %s sum %"PRIu64" max %"PRIu64, size_stat_names[j], users[i].sum[j], users[i].max[j]);
+            // "<bound>:count", the counts of sizes below bound (and at least the previous bound)
+            for (int k = 0; k < SIZE_BUCKETS; k++) {
+                if (!users[i].hist[j][k])
+                    continue;
+                if (k == 0)
+                    fprintf(out, " 0:%"PRIu64, users[i].hist[j][k]);
+                else if (k == SIZE_BUCKETS - 1)
+                    fprintf(out, " inf:%"PRIu64, users[i].hist[j][k]);
+                else
+                    fprintf(out, " <%s:%"PRIu64, _human(1ULL << k, bound, sizeof(bound)), users[i].hist[j][k]);
+            }
+            fputc('\n', out);
+        }
+    }
+    if (fclose(out) != 0 || rename(tmp, size_stats_file) != 0) {
+        error("job_submit/info: can't write %s: %m", size_stats_file);
+        unlink(tmp);
+    }
+    xfree(users);
+}
+
+static void* _writer(void* arg) {
+    struct timespec ts = { flush_interval / 1000, (flush_interval % 1000) * 1000000 };
+    while (!__atomic_load_n(&writer_stop, __ATOMIC_ACQUIRE)) {
+        if (size_stats && time(NULL) >= sizes_next_dump) {
+            _dump_sizes();
+            sizes_next_dump = time(NULL) + size_stats_interval;
+        }
+        if (_drain() == 0)
+            nanosleep(&ts, NULL);
+    }
+    while (_drain() > 0)
+        ;
+    if (size_stats)
+        _dump_sizes();
+    return NULL;
+}
+
 extern int init (void) {
+    char *conf_file = NULL;
+    struct stat config_stat;
+    s_p_hashtbl_t *tbl = NULL;
+    char* format = NULL;
+    char* oversize_action = NULL;
+
+    // read conf file, optional
+    conf_file = get_extra_conf_path("info.conf");
+    if (stat(conf_file, &config_stat) == 0) {
+        tbl = s_p_hashtbl_create(info_options);
+        if (s_p_parse_file(tbl, NULL, conf_file, false) == SLURM_ERROR)
+            fatal("Can't parse info.conf %s: %m", conf_file);
+        s_p_get_string(&log_file, "LogFile", tbl);
+        s_p_get_uint32(&buffer_size, "BufferSize", tbl);
+        s_p_get_uint32(&max_record_size, "MaxRecordSize", tbl);
+        s_p_get_uint64(&max_log_size, "MaxLogSize", tbl);
+        s_p_get_uint32(&log_files, "LogFiles", tbl);
+        s_p_get_uint32(&flush_interval, "FlushInterval", tbl);
+        s_p_get_string(&format, "Format", tbl);
+        s_p_get_boolean(&size_stats, "SizeStats", tbl);
+        s_p_get_string(&size_stats_file, "SizeStatsFile", tbl);
+        s_p_get_uint32(&size_stats_interval, "SizeStatsInterval", tbl);
+        s_p_get_uint64(&max_script_size, "MaxScriptSize", tbl);
+        s_p_get_uint64(&max_env_size, "MaxEnvSize", tbl);
+        s_p_get_uint32(&max_env_count, "MaxEnvCount", tbl);
+        s_p_get_uint64(&max_env_var_size, "MaxEnvVarSize", tbl);
+        s_p_get_uint64(&max_argv_size, "MaxArgvSize", tbl);
+        s_p_get_string(&oversize_action, "OversizeAction", tbl);
+        s_p_hashtbl_destroy(tbl);
+    }
+    xfree(conf_file);
+
+    if (!format || xstrcasecmp(format, "text") == 0)
+        binary_format = false;
+    else if (xstrcasecmp(format, "binary") == 0)
+        binary_format = true;
+    else
+        fatal("job_submit/info: unknown Format %s", format);
+    xfree(format);
+
+    if (!oversize_action || xstrcasecmp(oversize_action, "reject") == 0)
+        oversize_strip = false;
+    else if (xstrcasecmp(oversize_action, "strip") == 0)
+        oversize_strip = true;
+    else
+        fatal("job_submit/info: unknown OversizeAction %s", oversize_action);
+    xfree(oversize_action);
+
+    if (!size_stats_file)
+        size_stats_file = xstrdup("/tmp/slurm-jobs-sizes.log");
+    if (size_stats_interval < 1)
+        size_stats_interval = 1;
+    sizes_start = time(NULL);
+    sizes_next_dump = sizes_start + size_stats_interval;
+
+    if (!log_file)
+        log_file = xstrdup(binary_format ? "/tmp/slurm-jobs-info.cap" : "/tmp/slurm-jobs-info.log");
+    if (max_record_size < 1024)
+        max_record_size = 1024;
+    if (flush_interval < 1)
+        flush_interval = 1;
+
+    // power of 2, with room for at least a couple of full records
+    uint64_t size = 4096;
+    while (size < buffer_size || size < 4 * RECORD_SPACE(max_record_size))
+        size <<= 1;
+    ring = xmalloc(size);
+    ring_mask = size - 1;
+    ring_head = ring_tail = 0;
+    dropped = 0;
+
+    debug("job_submit/info: LogFile=%s Format=%s BufferSize=%"PRIu64" MaxRecordSize=%u MaxLogSize=%"PRIu64" LogFiles=%u FlushInterval=%u",
+          log_file, binary_format ? "binary" : "text", size, max_record_size, max_log_size, log_files, flush_interval);
+    debug("job_submit/info: SizeStats=%s SizeStatsFile=%s SizeStatsInterval=%u MaxScriptSize=%"PRIu64" MaxEnvSize=%"PRIu64" MaxEnvCount=%u MaxEnvVarSize=%"PRIu64" MaxArgvSize=%"PRIu64" OversizeAction=%s",
+          size_stats ? "yes" : "no", size_stats_file, size_stats_interval, max_script_size, max_env_size,
+          max_env_count, max_env_var_size, max_argv_size, oversize_strip ? "strip" : "reject");
+
+    writer_stop = false;
+    if (pthread_create(&writer_thread, NULL, _writer, NULL) != 0)
+        fatal("job_submit/info: can't create writer thread: %m");
+    writer_running = true;
+
     return SLURM_SUCCESS;
 }
 
 extern int fini (void) {
+    if (writer_running) {
+        __atomic_store_n(&writer_stop, true, __ATOMIC_RELEASE);
+        pthread_join(writer_thread, NULL);
+        writer_running = false;
+    }
+    if (log_fd >= 0) {
+        close(log_fd);
+        log_fd = -1;
+    }
+    xfree(ring);
+    xfree(log_file);
+    xfree(size_stats_file);
+    xfree(user_sizes);
+    user_sizes_size = user_sizes_count = 0;
     return SLURM_SUCCESS;
 }
 
+/* pushes the job as a job_capture.h record, dropped if too long */
+static void _capture(struct job_descriptor *job_desc, uint32_t submit_uid) {
+    job_capture_buf_t buf = { NULL, 0, 0 };
+    job_capture_begin(&buf, JOB_CAPTURE_SUBMIT, time(NULL), submit_uid);
+    job_capture_encode(&buf, job_desc);
+    job_capture_end(&buf);
+    if (buf.len > max_record_size || !_ring_push(buf.data, buf.len))
+        __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+    xfree(buf.data);
+}
+
+static inline uint64_t _array_bytes(char** array, uint32_t count) {
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; array && i < count; i++)
+        bytes += array[i] ? strlen(array[i]) + 1 : 0;
+    return bytes;
+}
+
+/*
+  measures the job sizes (and the longest environment variable), stripping
+  the long environment variables if OversizeAction=strip. returns the number
+  of stripped variables
+*/
+static uint32_t _measure(struct job_descriptor *job_desc, uint64_t sizes[SIZE_STATS], uint64_t* max_var) {
+    uint32_t stripped = 0;
+    uint32_t kept = 0;
+
+    sizes[SIZE_SCRIPT] = job_desc->script ? strlen(job_desc->script) : 0;
+    sizes[SIZE_ARGV] = _array_bytes(job_desc->argv, job_desc->argc);
+    sizes[SIZE_ENV] = 0;
+    for (uint32_t i = 0; job_desc->environment && i < job_desc->env_size; i++) {
+        char* var = job_desc->environment[i];
+        uint64_t len = var ? strlen(var) + 1 : 0;
+        if (oversize_strip && max_env_var_size && len > max_env_var_size) {
+            char bytes[32];
+            info("job_submit/info: stripping %.*s (%s) from the environment of uid %u",
+                 (int)strcspn(var, "="), var, _human(len, bytes, sizeof(bytes)), job_desc->user_id);
+            xfree(var);
+            stripped++;
+            continue;
+        }
+        job_desc->environment[kept++] = var;
+        sizes[SIZE_ENV] += len;
+        *max_var = MAX(*max_var, len);
+    }
+    if (stripped) {
+        job_desc->env_size = kept;
+        job_desc->environment[kept] = NULL;
+    }
+    sizes[SIZE_ENV_COUNT] = job_desc->env_size;
+    return stripped;
+}
+
+/* checks the sizes against the limits, setting err_msg if over */
+static bool _oversize(const uint64_t sizes[SIZE_STATS], uint64_t max_var, char** err_msg) {
+    static const char clean_env[] = " Please submit from a cleaner environment (or use --export).";
+    char size[32];
+    char limit[32];
+
+    if (max_script_size && sizes[SIZE_SCRIPT] > max_script_size) {
+        *err_msg = xstrdup_printf("The job script is %sB, the limit is %sB.",
+                                  _human(sizes[SIZE_SCRIPT], size, sizeof(size)),
+                                  _human(max_script_size, limit, sizeof(limit)));
+    } else if (max_env_size && sizes[SIZE_ENV] > max_env_size) {
+        *err_msg = xstrdup_printf("The job environment is %sB, the limit is %sB.%s",
+                                  _human(sizes[SIZE_ENV], size, sizeof(size)),
+                                  _human(max_env_size, limit, sizeof(limit)), clean_env);
+    } else if (max_env_count && sizes[SIZE_ENV_COUNT] > max_env_count) {
+        *err_msg = xstrdup_printf("The job environment has %"PRIu64" variables, the limit is %u.%s",
+                                  sizes[SIZE_ENV_COUNT], max_env_count, clean_env);
+    } else if (max_env_var_size && max_var > max_env_var_size) {
+        *err_msg = xstrdup_printf("The job environment has a %sB variable, the limit is %sB.%s",
+                                  _human(max_var, size, sizeof(size)),
+                                  _human(max_env_var_size, limit, sizeof(limit)), clean_env);
+    } else if (max_argv_size && sizes[SIZE_ARGV] > max_argv_size) {
+        *err_msg = xstrdup_printf("The job command line is %sB, the limit is %sB.",
+                                  _human(sizes[SIZE_ARGV], size, sizeof(size)),
+                                  _human(max_argv_size, limit, sizeof(limit)));
+    } else {
+        return false;
+    }
+    return true;
+}
+
 extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid, char **err_msg) {
+    if (size_stats || max_script_size || max_env_size || max_env_count || max_env_var_size || max_argv_size) {
+        uint64_t sizes[SIZE_STATS];
+        uint64_t max_var = 0;
+        uint32_t stripped = _measure(job_desc, sizes, &max_var);
+        bool rejected = _oversize(sizes, max_var, err_msg);
+        if (size_stats)
+            _count_sizes(job_desc->user_id, sizes, rejected, stripped > 0);
+        if (rejected) {
+            info("job_submit/info: rejecting job of uid %u: %s", job_desc->user_id, *err_msg);
+            return ESLURM_NOT_SUPPORTED;
+        }
+    }
+
+    if (binary_format) {
+        _capture(job_desc, submit_uid);
+        return SLURM_SUCCESS;
+    }
+
     // NOTE: no job id actually exists yet (=NO_VAL)
-    char buf[1024];
-    snprintf(buf, sizeof(buf), "/tmp/slurm-jobs-info-%zi.out", time(NULL));
-    FILE* out = fopen(buf, "w");
-    //if (out == NULL)
-    //    return SLURM_ERROR;
+    rec_t rec = { NULL, 0, MIN(4096, max_record_size), false };
+    rec.data = xmalloc(rec.size);
+
+    _rec_printf(&rec, "=== %ld submit %"PRIu64" uid %u\n", (long)time(NULL),
+                __atomic_fetch_add(&sequence, 1, __ATOMIC_RELAXED), submit_uid);
 
-    snprintf(buf, sizeof(buf), "account: %s\n", job_desc->account);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "account: %s\n", _str(job_desc->account));
 
-    snprintf(buf, sizeof(buf), "acctg_freq: %s\n", job_desc->acctg_freq);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "acctg_freq: %s\n", _str(job_desc->acctg_freq));
 
     //snprintf(buf, sizeof(buf), "admin_comment: %s", job_desc->admin_comment);
     //fwrite(buf, 1, strlen(buf), out);
 
-    snprintf(buf, sizeof(buf), "alloc_node: %s\n", job_desc->alloc_node);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "alloc_node: %s\n", _str(job_desc->alloc_node));
 
-    snprintf(buf, sizeof(buf), "alloc_resp_port: %i\n", job_desc->alloc_resp_port);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "alloc_resp_port: %i\n", job_desc->alloc_resp_port);
 
-    snprintf(buf, sizeof(buf), "alloc_sid: %i\n", job_desc->alloc_sid);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "alloc_sid: %i\n", job_desc->alloc_sid);
 
-    snprintf(buf, sizeof(buf), "time_limit (min): %i\n", job_desc->time_limit);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "time_limit (min): %i\n", job_desc->time_limit);
 
-    snprintf(buf, sizeof(buf), "time_min (min): %i\n", job_desc->time_min);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "time_min (min): %i\n", job_desc->time_min);
 
-    snprintf(buf, sizeof(buf), "argc: %i\n", job_desc->argc);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "argc: %i\n", job_desc->argc);
 
     for(int i = 0; i < job_desc->argc; i++) {
-        snprintf(buf, sizeof(buf), "argv[%i]: %s\n", i, job_desc->argv[i]);
-        fwrite(buf, 1, strlen(buf), out);
+        _rec_printf(&rec, "argv[%i]: %s\n", i, _str(job_desc->argv[i]));
     }
 
-    snprintf(buf, sizeof(buf), "spank_job_env_size: %i\n", job_desc->spank_job_env_size);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "spank_job_env_size: %i\n", job_desc->spank_job_env_size);
 
     for(int i = 0; i < job_desc->spank_job_env_size; i++) {
-        snprintf(buf, sizeof(buf), "spank_job_env[%i]: %s\n", i, job_desc->spank_job_env[i]);
-        fwrite(buf, 1, strlen(buf), out);
+        _rec_printf(&rec, "spank_job_env[%i]: %s\n", i, _str(job_desc->spank_job_env[i]));
     }
 
-    snprintf(buf, sizeof(buf), "env_size: %i\n", job_desc->env_size);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "env_size: %i\n", job_desc->env_size);
 
     for(int i = 0; i < job_desc->env_size; i++) {
-        snprintf(buf, sizeof(buf), "environment[%i]: %s\n", i, job_desc->environment[i]);
-        fwrite(buf, 1, strlen(buf), out);
+        _rec_printf(&rec, "environment[%i]: %s\n", i, _str(job_desc->environment[i]));
     }
 
-    snprintf(buf, sizeof(buf), "qos: %s\n", job_desc->qos);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "qos: %s\n", _str(job_desc->qos));
 
-    snprintf(buf, sizeof(buf), "std_err: %s\n", job_desc->std_err);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "std_err: %s\n", _str(job_desc->std_err));
     
-    snprintf(buf, sizeof(buf), "std_in: %s\n", job_desc->std_in);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "std_in: %s\n", _str(job_desc->std_in));
 
-    snprintf(buf, sizeof(buf), "std_out: %s\n", job_desc->std_out);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "std_out: %s\n", _str(job_desc->std_out));
 
-    snprintf(buf, sizeof(buf), "licenses: %s\n", job_desc->licenses);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "licenses: %s\n", _str(job_desc->licenses));
 
-    snprintf(buf, sizeof(buf), "job_id_str: %s\n", job_desc->job_id_str);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "job_id_str: %s\n", _str(job_desc->job_id_str));
     
-    snprintf(buf, sizeof(buf), "script: %s\n", job_desc->script);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "script: %s\n", _str(job_desc->script));
 
-    snprintf(buf, sizeof(buf), "num_tasks: %i\n", job_desc->num_tasks);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "num_tasks: %i\n", job_desc->num_tasks);
 
-    snprintf(buf, sizeof(buf), "ntasks_per_node: %i\n", job_desc->ntasks_per_node);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "ntasks_per_node: %i\n", job_desc->ntasks_per_node);
 
-    snprintf(buf, sizeof(buf), "ntasks_per_socket: %i\n", job_desc->ntasks_per_socket);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "ntasks_per_socket: %i\n", job_desc->ntasks_per_socket);
 
-    snprintf(buf, sizeof(buf), "ntasks_per_core: %i\n", job_desc->ntasks_per_core);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "ntasks_per_core: %i\n", job_desc->ntasks_per_core);
 
-    snprintf(buf, sizeof(buf), "ntasks_per_board: %i\n", job_desc->ntasks_per_board);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "ntasks_per_board: %i\n", job_desc->ntasks_per_board);
 
-    snprintf(buf, sizeof(buf), "req_nodes: %s\n", job_desc->req_nodes);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "req_nodes: %s\n", _str(job_desc->req_nodes));
 
-    snprintf(buf, sizeof(buf), "min_nodes: %i\n", job_desc->min_nodes);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "min_nodes: %i\n", job_desc->min_nodes);
 
-    snprintf(buf, sizeof(buf), "max_nodes: %i\n", job_desc->max_nodes);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "max_nodes: %i\n", job_desc->max_nodes);
 
 #if SLURM_VERSION_NUMBER < SLURM_VERSION_NUM(19,5,0)
-    snprintf(buf, sizeof(buf), "gres: %s\n", job_desc->gres);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "gres: %s\n", _str(job_desc->gres));
 #else
-    snprintf(buf, sizeof(buf), "tres_per_job: %s\n", job_desc->tres_per_job);
-    fwrite(buf, 1, strlen(buf), out);
-    snprintf(buf, sizeof(buf), "tres_per_node: %s\n", job_desc->tres_per_node);
-    fwrite(buf, 1, strlen(buf), out);
-    snprintf(buf, sizeof(buf), "tres_per_socket: %s\n", job_desc->tres_per_socket);
-    fwrite(buf, 1, strlen(buf), out);
-    snprintf(buf, sizeof(buf), "tres_per_task: %s\n", job_desc->tres_per_task);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "tres_per_job: %s\n", _str(job_desc->tres_per_job));
+    _rec_printf(&rec, "tres_per_node: %s\n", _str(job_desc->tres_per_node));
+    _rec_printf(&rec, "tres_per_socket: %s\n", _str(job_desc->tres_per_socket));
+    _rec_printf(&rec, "tres_per_task: %s\n", _str(job_desc->tres_per_task));
 #endif
 
-    snprintf(buf, sizeof(buf), "partition: %s\n", job_desc->partition);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "partition: %s\n", _str(job_desc->partition));
 
-    snprintf(buf, sizeof(buf), "features: %s\n", job_desc->features);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "features: %s\n", _str(job_desc->features));
 
-    snprintf(buf, sizeof(buf), "cluster_features: %s\n", job_desc->cluster_features);
-    fwrite(buf, 1, strlen(buf), out);
+    _rec_printf(&rec, "cluster_features: %s\n", _str(job_desc->cluster_features));
 
 //	char *array_inx;	/* job array index values */
 //	void *array_bitmap;	/* NOTE: Set by slurmctld */
@@ -306,14 +901,14 @@ extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid, char
 #else
     if (assoc_mgr_fill_in_user(acct_db_conn, &user, accounting_enforce, NULL, false) != SLURM_ERROR) {
 #endif
-        snprintf(buf, sizeof(buf), "default account: %s\n", user.default_acct);
+        _rec_printf(&rec, "default account: %s\n", _str(user.default_acct));
     } else {
-        snprintf(buf, sizeof(buf), "default account: %s\n", "(null)");
+        _rec_printf(&rec, "default account: %s\n", "(null)");
     }
-    fwrite(buf, 1, strlen(buf), out);
 
-    fflush(out);
-    fclose(out);
+    if (!_ring_push(rec.data, rec.len))
+        __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+    xfree(rec.data);
 
     return SLURM_SUCCESS;
 }
@@ -33,6 +33,8 @@
 #include "src/common/xstring.h"
 #include "src/common/assoc_mgr.h"
 
+#include "partition_set.h"
+
 const char plugin_name[]="killable";
 const char plugin_type[]="job_submit/killable";
 const uint32_t plugin_version = SLURM_VERSION_NUMBER;
@@ -43,6 +45,7 @@ s_p_options_t user_options[] = {
     {"Account", S_P_STRING},
     {"QOS", S_P_STRING},
     {"Partition", S_P_STRING},
+    {"Tier", S_P_UINT32},
     {NULL}
 };
 
@@ -51,9 +54,22 @@ s_p_options_t primary_group_options[] = {
     {"Account", S_P_STRING},
     {"QOS", S_P_STRING},
     {"Partition", S_P_STRING},
+    {"Tier", S_P_UINT32},
     {NULL}
 };
 
+/*
+  spank_killable sets KILLABLE=<version>:<tier> in the job control environment
+  (job_desc->spank_job_env, the SPANK_ prefix is only added when exported to
+  the prolog/epilog). Older clients only have the option itself, as
+  _SLURM_SPANK_OPTION_killable_killable=<tier or (null)>
+*/
+#define KILLABLE_ENV "KILLABLE="
+#define KILLABLE_LEGACY_ENV "_SLURM_SPANK_OPTION_killable_killable="
+
+// a Tier setting matching all tiers
+#define ANY_TIER -1
+
 static s_p_options_t killable_options[] = {
     {"User", S_P_LINE, NULL, NULL, user_options},
     {"PrimaryGroup", S_P_LINE, NULL, NULL, primary_group_options},
@@ -70,6 +86,12 @@ char** pgroup_keys = NULL;
 char** pgroup_values = NULL;
 char** pgroup_qos = NULL;
 char** pgroup_partition = NULL;
+int64_t* user_tier = NULL;
+int64_t* pgroup_tier = NULL;
+// the Partition settings normalized against part_list, rebuilt on part_list
+// changes
+char** user_parts = NULL;
+char** pgroup_parts = NULL;
 
 extern int init (void) {
 
@@ -104,16 +126,22 @@ extern int init (void) {
     pgroup_values = xmalloc(pgroup_count * sizeof(char*));
     pgroup_qos = xmalloc(pgroup_count * sizeof(char*));
     pgroup_partition = xmalloc(pgroup_count * sizeof(char*));
+    user_parts = xmalloc(user_count * sizeof(char*));
+    pgroup_parts = xmalloc(pgroup_count * sizeof(char*));
+    user_tier = xmalloc(user_count * sizeof(int64_t));
+    pgroup_tier = xmalloc(pgroup_count * sizeof(int64_t));
     
     for (int i = 0; i < user_count; i++) {
         char* user;
         char* account;
         char* qos;
         char* partition;
+        uint32_t tier;
         user_keys[i] = NULL;
         user_values[i] = NULL;
         user_qos[i] = NULL;
         user_partition[i] = NULL;
+        user_tier[i] = ANY_TIER;
         if (s_p_get_string(&user, "User", users[i])) {
             user_keys[i] = user;
             if (s_p_get_string(&account, "Account", users[i])) {
@@ -125,6 +153,9 @@ extern int init (void) {
             if (s_p_get_string(&partition, "Partition", users[i])) {
                 user_partition[i] = partition;
             }
+            if (s_p_get_uint32(&tier, "Tier", users[i])) {
+                user_tier[i] = tier;
+            }
 
             if (strlen(buffer) < sizeof(buffer) - 1) {
                 if (buffer[0])
@@ -142,10 +173,12 @@ extern int init (void) {
         char* account;
         char* qos;
         char* partition;
+        uint32_t tier;
         pgroup_keys[i] = NULL;
         pgroup_values[i] = NULL;
         pgroup_qos[i] = NULL;
         pgroup_partition[i] = NULL;
+        pgroup_tier[i] = ANY_TIER;
         if (s_p_get_string(&pgroup, "PrimaryGroup", pgroups[i])) {
             pgroup_keys[i] = pgroup;
             if (s_p_get_string(&account, "Account", pgroups[i])) {
@@ -157,6 +190,9 @@ extern int init (void) {
             if (s_p_get_string(&partition, "Partition", pgroups[i])) {
                 pgroup_partition[i] = partition;
             }
+            if (s_p_get_uint32(&tier, "Tier", pgroups[i])) {
+                pgroup_tier[i] = tier;
+            }
 
             if (strlen(buffer) < sizeof(buffer) - 1) {
                 if (buffer[0])
@@ -168,7 +204,8 @@ extern int init (void) {
 
     info("job_submit/killable: found %i killable primarygroup settings (%s)", pgroup_count, buffer);
 
-    // FIXME, validate somehow?
+    // FIXME, validate accounts and qos somehow? (partitions are validated
+    // on first use, see _sync_partitions())
 
     s_p_hashtbl_destroy(options);
     options = NULL;
@@ -194,6 +231,7 @@ extern int fini (void) {
             xfree(user_partition[i]);
             user_partition[i] = NULL;
         }
+        xfree(user_parts[i]);
     }
     for (int i = 0 ; i < pgroup_count; i++) {
         xfree(pgroup_keys[i]);
@@ -210,22 +248,107 @@ extern int fini (void) {
             xfree(pgroup_partition[i]);
             pgroup_partition[i] = NULL;
         }
+        xfree(pgroup_parts[i]);
     }
     xfree(user_keys);
     xfree(user_values);
     xfree(user_qos);
     xfree(user_partition);
+    xfree(user_parts);
+    xfree(user_tier);
     user_count = 0;
     xfree(pgroup_keys);
     xfree(pgroup_values);
     xfree(pgroup_qos);
     xfree(pgroup_partition);
+    xfree(pgroup_parts);
+    xfree(pgroup_tier);
     pgroup_count = 0;
+    part_registry_fini();
     return SLURM_SUCCESS;
 }
 
+/* renormalize the Partition settings if the partitions changed */
+static void _sync_partitions(void) {
+    if (!part_registry_sync())
+        return;
+
+    for (int i = 0; i < user_count; i++) {
+        xfree(user_parts[i]);
+        if (user_partition[i])
+            user_parts[i] = part_set_normalize(user_partition[i], "job_submit/killable");
+    }
+    for (int i = 0; i < pgroup_count; i++) {
+        xfree(pgroup_parts[i]);
+        if (pgroup_partition[i])
+            pgroup_parts[i] = part_set_normalize(pgroup_partition[i], "job_submit/killable");
+    }
+}
+
+/* the partitions to set, keeps the configured value if nothing is valid, so
+   slurm will reject it properly */
+inline static char* _user_partition(int i) {
+    return user_parts[i] ? user_parts[i] : user_partition[i];
+}
+
+inline static char* _pgroup_partition(int i) {
+    return pgroup_parts[i] ? pgroup_parts[i] : pgroup_partition[i];
+}
+
+/* the tier of "<version>:<tier>" or "<tier>", 0 if not given */
+static uint32_t _parse_tier(const char* value) {
+    char* end;
+    unsigned long tier;
+    const char* colon = strchr(value, ':');
+    if (colon)
+        value = colon + 1;
+    tier = strtoul(value, &end, 10);
+    if (end == value || *end)
+        return 0;
+    return tier;
+}
+
+/*
+  true if the job is killable, and sets its tier. Stops at the first killable
+  entry, and only compares its prefix
+*/
+static bool _killable(const struct job_descriptor *job_desc, uint32_t* tier) {
+    for (int i = 0; i < job_desc->spank_job_env_size; i++) {
+        const char* env = job_desc->spank_job_env[i];
+        if (strncmp(env, KILLABLE_ENV, sizeof(KILLABLE_ENV) - 1) == 0) {
+            // version 0 (or no version) isn't killable
+            if (strtoul(env + sizeof(KILLABLE_ENV) - 1, NULL, 10) == 0)
+                return false;
+            *tier = _parse_tier(env + sizeof(KILLABLE_ENV) - 1);
+            return true;
+        }
+        if (strncmp(env, KILLABLE_LEGACY_ENV, sizeof(KILLABLE_LEGACY_ENV) - 1) == 0) {
+            *tier = _parse_tier(env + sizeof(KILLABLE_LEGACY_ENV) - 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+inline static bool _tier_matches(int64_t setting, uint32_t tier) {
+    return setting == ANY_TIER || setting == tier;
+}
+
+/*
+  sets a *default value. A line with the job's exact Tier takes precedence over
+  a line without Tier, otherwise the last line wins.
+*/
+static void _set_default(char** value, bool* exact, const char* setting, bool setting_exact) {
+    if (!setting || (*exact && !setting_exact))
+        return;
+    xfree(*value);
+    *value = xstrdup(setting);
+    *exact = setting_exact;
+}
+
 extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid, char **err_msg) {
     bool is_killable = false;
+    uint32_t tier = 0;
     slurmdb_user_rec_t user;
     bool found_account = false;
     bool found_qos = false;
@@ -233,14 +356,15 @@ extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid, char
     char* default_account = NULL;
     char* default_qos = NULL;
     char* default_partition = NULL;
+    bool default_account_exact = false;
+    bool default_qos_exact = false;
+    bool default_partition_exact = false;
+
+    is_killable = _killable(job_desc, &tier);
 
-    for (int i = 0; i < job_desc->spank_job_env_size; i++) {
-        if (strcmp(job_desc->spank_job_env[i], "_SLURM_SPANK_OPTION_killable_killable=(null)") == 0) {
-            is_killable = true;
-        }
-    }
-        
     if (is_killable) {
+        _sync_partitions();
+
         memset(&user, 0, sizeof(slurmdb_user_rec_t));
         user.uid = job_desc->user_id;
 #if SLURM_VERSION_NUMBER < SLURM_VERSION_NUM(19,5,0)
@@ -254,6 +378,8 @@ extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid, char
 
         // first try specific user
         for (int i = 0; i < user_count; i++) {
+            if (!_tier_matches(user_tier[i], tier))
+                continue;
             if (strcmp(user_keys[i], user.name) == 0) {
                 if (user_values[i]) {
                     if (job_desc->account) {
@@ -273,26 +399,21 @@ extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid, char
                     if (job_desc->partition) {
                         xfree(job_desc->partition);
                     }
-                    job_desc->partition = xstrdup(user_partition[i]);
+                    job_desc->partition = xstrdup(_user_partition(i));
                     found_partition = true;
                 }
             }
 
             if (strcmp(user_keys[i], "*default") == 0) {
+                bool exact = user_tier[i] != ANY_TIER;
                 if (!found_account) {
-                    if (user_values[i]) {
-                        default_account = xstrdup(user_values[i]);
-                    }
+                    _set_default(&default_account, &default_account_exact, user_values[i], exact);
                 }
                 if (!found_qos) {
-                    if (user_qos[i]) {
-                        default_qos = xstrdup(user_qos[i]);
-                    }
+                    _set_default(&default_qos, &default_qos_exact, user_qos[i], exact);
                 }
-                if (!found_partition) {
-                    if (user_partition[i]) {
-                        default_partition = xstrdup(user_partition[i]);
-                    }
+                if (!found_partition && user_partition[i]) {
+                    _set_default(&default_partition, &default_partition_exact, _user_partition(i), exact);
                 }
             }
         }
@@ -329,6 +450,8 @@ extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid, char
             buffer = NULL;
 
             for (int i = 0; i < pgroup_count; i++) {
+                if (!_tier_matches(pgroup_tier[i], tier))
+                    continue;
                 if (strcmp(pgroup_keys[i], gr.gr_name) == 0) {
                     if (pgroup_values[i]) {
                         if (job_desc->account) {
@@ -348,7 +471,7 @@ extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid, char
                         if (job_desc->partition) {
                             xfree(job_desc->partition);
                         }
-                        job_desc->partition = xstrdup(pgroup_partition[i]);
+                        job_desc->partition = xstrdup(_pgroup_partition(i));
                         found_partition = true;
                     }
                 }
@@ -374,7 +497,7 @@ extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid, char
             }
             job_desc->partition = xstrdup(default_partition);
         }
-        info("job_submit/killable: killable, setting account/partition/qos: %s/%s/%s", job_desc->account, job_desc->partition, job_desc->qos);
+        info("job_submit/killable: killable (tier %u), setting account/partition/qos: %s/%s/%s", tier, job_desc->account, job_desc->partition, job_desc->qos);
 
         if (default_account) {
             xfree(default_account);
@@ -23,9 +23,12 @@
  *
  *****************************************************************************/
 
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <slurm/slurm.h>
@@ -33,8 +36,12 @@
 
 #include "src/slurmctld/slurmctld.h"
 #include "src/slurmctld/licenses.h"
+#include "src/slurmctld/reservation.h"
 
 #include "src/common/xstring.h"
+#include "src/common/assoc_mgr.h"
+
+#include "partition_set.h"
 
 const char plugin_name[]="Limit interactive jobs";
 const char plugin_type[]="job_submit/limit_interactive";
@@ -44,10 +51,62 @@ const uint32_t plugin_version = SLURM_VERSION_NUMBER;
 static s_p_options_t limit_interactive_options[] = {
 	{"Partition", S_P_STRING},
 	{"DefaultLimit", S_P_UINT16},
+	{"MaxNodes", S_P_UINT32},
+	{"CheckLimit", S_P_BOOLEAN},
+	{"SubmitRate", S_P_UINT32},
+	{"SubmitBurst", S_P_UINT32},
+	{"PoolReservation", S_P_STRING},
+	{"PoolMaxCPUs", S_P_UINT32},
+	{"PoolMaxMemory", S_P_UINT64},
 	{NULL}
 };
 
+#define LICENSE_NAME "interactive"
+
 char* limit_partition = NULL;
+// limit_partition normalized against part_list, rebuilt on part_list changes
+char* limit_parts = NULL;
+// maximum number of nodes (and licenses) per interactive job, 0 for unlimited
+uint32_t max_interactive_nodes = 9;
+// reject jobs which can't start due to their association interactive limit
+bool check_limit = true;
+// position of license/interactive in the assoc_mgr tres arrays
+int license_tres_pos = -1;
+
+// interactive submissions per minute per user, 0 for unlimited
+uint32_t submit_rate = 0;
+// maximum submissions at once (bucket size)
+uint32_t submit_burst = 10;
+
+// reservation of warm (idle) nodes for small interactive jobs, see
+// interactive-pool.sh
+char* pool_reservation = NULL;
+// largest job (cpus, memory in MB) redirected to the pool
+uint32_t pool_max_cpus = 4;
+uint64_t pool_max_memory = 0;
+
+/*
+  Per user token buckets for submit_rate. Fixed size, allocated once, split
+  into shards (by uid) each with its own lock. A user not in its shard takes
+  an unused or idle bucket (see _rate_take()).
+*/
+#define RATE_SHARDS 16
+#define RATE_SHARD_SLOTS 64
+#define RATE_TOKEN 1000     // tokens are kept in 1/1000 of a submission
+
+typedef struct rate_bucket {
+    uint32_t uid;
+    bool used;
+    uint64_t tokens;
+    uint64_t last;          // last refill, in ms (monotonic)
+} rate_bucket_t;
+
+typedef struct rate_shard {
+    pthread_mutex_t lock;
+    rate_bucket_t buckets[RATE_SHARD_SLOTS];
+} rate_shard_t;
+
+static rate_shard_t rate_shards[RATE_SHARDS];
 
 uint32_t license_get_total_cnt_from_list(List license_list, char *name);
 
@@ -67,12 +126,31 @@ extern int init (void) {
         fatal("Can't parse limit_interactive.conf %s: %m", conf_file);
 
     s_p_get_string(&limit_partition, "Partition", tbl);
+    s_p_get_uint32(&max_interactive_nodes, "MaxNodes", tbl);
+    s_p_get_boolean(&check_limit, "CheckLimit", tbl);
+    s_p_get_uint32(&submit_rate, "SubmitRate", tbl);
+    s_p_get_uint32(&submit_burst, "SubmitBurst", tbl);
+    if (submit_burst < 1)
+        submit_burst = 1;
+    s_p_get_string(&pool_reservation, "PoolReservation", tbl);
+    s_p_get_uint32(&pool_max_cpus, "PoolMaxCPUs", tbl);
+    s_p_get_uint64(&pool_max_memory, "PoolMaxMemory", tbl);
+    if (pool_reservation)
+        debug("job_submit/limit_interactive: PoolReservation=%s PoolMaxCPUs=%u PoolMaxMemory=%"PRIu64,
+              pool_reservation, pool_max_cpus, pool_max_memory);
+    debug("job_submit/limit_interactive: MaxNodes=%u CheckLimit=%i SubmitRate=%u SubmitBurst=%u",
+          max_interactive_nodes, check_limit, submit_rate, submit_burst);
+
+    for (int i = 0; i < RATE_SHARDS; i++) {
+        pthread_mutex_init(&rate_shards[i].lock, NULL);
+        memset(rate_shards[i].buckets, 0, sizeof(rate_shards[i].buckets));
+    }
 
     s_p_hashtbl_destroy(tbl);
     xfree(conf_file);
 
-    // validate
-    // FIXME, validate limit_interactive is a/are real partition(s)
+    // limit_partition is validated on first use (and whenever part_list
+    // changes), see _sync_partitions()
 
     return SLURM_SUCCESS;
 }
@@ -80,9 +158,313 @@ extern int init (void) {
 extern int fini (void) {
     xfree(limit_partition);
     limit_partition = NULL;
+    xfree(limit_parts);
+    xfree(pool_reservation);
+    part_registry_fini();
+    for (int i = 0; i < RATE_SHARDS; i++) {
+        pthread_mutex_destroy(&rate_shards[i].lock);
+    }
     return SLURM_SUCCESS;
 }
 
+/* renormalize limit_partition if the partitions changed */
+static void _sync_partitions(void) {
+    if (!part_registry_sync())
+        return;
+
+    xfree(limit_parts);
+    limit_parts = part_set_normalize(limit_partition, "job_submit/limit_interactive");
+    if (limit_parts == NULL)
+        error("job_submit/limit_interactive: no valid partitions in %s", limit_partition);
+}
+
+/*
+  parses a single licenses token (name, name:count or name*count, see slurm's
+  licenses.c), of length len.
+  returns 1 and sets *count if it's the interactive license, 0 if it's another
+  license, -1 if it's malformed
+*/
+static int _parse_license_token(const char* token, size_t len, uint32_t* count) {
+    size_t name_len = 0;
+    while (name_len < len && token[name_len] != ':' && token[name_len] != '*')
+        name_len++;
+
+    if (name_len != strlen(LICENSE_NAME) || strncmp(token, LICENSE_NAME, name_len) != 0)
+        return 0;
+
+    if (name_len == len) {
+        *count = 1;
+        return 1;
+    }
+
+    // digits only, no sign, no overflow
+    uint64_t num = 0;
+    size_t i = name_len + 1;
+    if (i == len)
+        return -1;
+    for (; i < len; i++) {
+        if (token[i] < '0' || token[i] > '9')
+            return -1;
+        num = num * 10 + (token[i] - '0');
+        if (num >= NO_VAL)
+            return -1;
+    }
+    *count = num;
+    return 1;
+}
+
+/*
+  looks for the interactive license in the licenses string.
+  returns 1 if found (with its count in *count, and its token position and
+  length in *token and *token_len), 0 if not found, -1 if the string is
+  malformed
+*/
+static int _find_license(const char* licenses, uint32_t* count, const char** token, size_t* token_len) {
+    const char* p = licenses;
+    while (p && *p) {
+        size_t len = strcspn(p, ",;");
+        if (len) {
+            int rc = _parse_license_token(p, len, count);
+            if (rc != 0) {
+                if (token) {
+                    *token = p;
+                    *token_len = len;
+                }
+                return rc;
+            }
+        }
+        p += len;
+        if (*p)
+            p++;
+    }
+    return 0;
+}
+
+/* builds "interactive:<count>" in buf, without allocations */
+inline static const char* _license_str(char* buf, size_t size, uint32_t count) {
+    snprintf(buf, size, LICENSE_NAME ":%u", count);
+    return buf;
+}
+
+/*
+  sets the interactive license in *licenses to licstr. token/token_len is the
+  existing interactive token in *licenses (as found by _find_license()), or
+  NULL to append.
+*/
+static void _set_license(char** licenses, const char* token, size_t token_len, const char* licstr) {
+    char* tmp_str = NULL;
+    if (*licenses == NULL) {
+        *licenses = xstrdup(licstr);
+        return;
+    }
+    if (token == NULL) {
+        xstrfmtcat(*licenses, ",%s", licstr);
+        return;
+    }
+    xstrncat(tmp_str, *licenses, token - *licenses);
+    xstrcat(tmp_str, licstr);
+    xstrcat(tmp_str, token + token_len);
+    xfree(*licenses);
+    *licenses = tmp_str;
+}
+
+/*
+  refills bucket up to now. last only advances by the time of the credited
+  tokens, so the fraction of a token isn't lost between frequent calls
+*/
+static void _rate_refill(rate_bucket_t* bucket, uint64_t now) {
+    uint64_t max = (uint64_t)submit_burst * RATE_TOKEN;
+    uint64_t per_minute = (uint64_t)submit_rate * RATE_TOKEN;
+    uint64_t credited = (now - bucket->last) * per_minute / 60000;
+
+    if (bucket->tokens + credited >= max) {
+        bucket->tokens = max;
+        bucket->last = now;
+    } else if (credited) {
+        bucket->tokens += credited;
+        bucket->last += credited * 60000 / per_minute;
+    }
+}
+
+/*
+  takes a submission token of uid
+  returns false if uid has no tokens left
+*/
+static bool _rate_take(uint32_t uid) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint64_t now = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    uint64_t full = (uint64_t)submit_burst * RATE_TOKEN;
+
+    rate_shard_t* shard = &rate_shards[(uid * 2654435761u) % RATE_SHARDS];
+    rate_bucket_t* bucket = NULL;
+    rate_bucket_t* victim = NULL;
+    bool allowed;
+
+    pthread_mutex_lock(&shard->lock);
+
+    // find the user's bucket, or the one to replace: an unused one, or the
+    // least recently used one (which is most likely full again, i.e. the
+    // same as a new bucket)
+    for (int i = 0; i < RATE_SHARD_SLOTS; i++) {
+        rate_bucket_t* b = &shard->buckets[i];
+        if (!b->used) {
+            if (!victim || victim->used)
+                victim = b;
+        } else if (b->uid == uid) {
+            bucket = b;
+            break;
+        } else if (!victim || (victim->used && b->last < victim->last)) {
+            victim = b;
+        }
+    }
+
+    if (bucket) {
+        _rate_refill(bucket, now);
+    } else {
+        bucket = victim;
+        bucket->used = true;
+        bucket->uid = uid;
+        bucket->tokens = full;
+        bucket->last = now;
+    }
+
+    allowed = bucket->tokens >= RATE_TOKEN;
+    if (allowed)
+        bucket->tokens -= RATE_TOKEN;
+
+    pthread_mutex_unlock(&shard->lock);
+
+    return allowed;
+}
+
+/*
+  returns the position of license/interactive in the assoc_mgr tres arrays, or
+  -1 if not tracked. The tres read lock should be held.
+*/
+static int _license_tres_pos(void) {
+    // cached, but verified as the tres array may be reloaded
+    if (license_tres_pos >= 0 &&
+        license_tres_pos < g_tres_count &&
+        xstrcmp(assoc_mgr_tres_array[license_tres_pos]->type, "license") == 0 &&
+        xstrcmp(assoc_mgr_tres_array[license_tres_pos]->name, LICENSE_NAME) == 0) {
+        return license_tres_pos;
+    }
+
+    slurmdb_tres_rec_t tres_rec;
+    memset(&tres_rec, 0, sizeof(slurmdb_tres_rec_t));
+    tres_rec.type = "license";
+    tres_rec.name = LICENSE_NAME;
+    license_tres_pos = assoc_mgr_find_tres_pos(&tres_rec, true);
+    return license_tres_pos;
+}
+
+/*
+  checks whether nlic interactive licenses are available for the job's
+  association, i.e. the running jobs of the association (and its parents)
+  leave enough of the GrpTRES license/interactive limit.
+
+  assoc_mgr keeps the limits and the usage of all associations in memory, so
+  this is a lookup and a walk up the association tree.
+
+  returns true if available (or if it can't tell), false otherwise, with an
+  explanation in *err_msg
+*/
+static bool _license_available(struct job_descriptor *job_desc, uint32_t nlic, char** err_msg) {
+    slurmdb_assoc_rec_t assoc_rec, *assoc_ptr = NULL;
+    assoc_mgr_lock_t locks = { .assoc = READ_LOCK, .tres = READ_LOCK };
+    bool available = true;
+
+    memset(&assoc_rec, 0, sizeof(slurmdb_assoc_rec_t));
+    assoc_rec.uid = job_desc->user_id;
+    assoc_rec.acct = job_desc->account;
+    // partition associations only when a single partition is requested
+    if (job_desc->partition && !strchr(job_desc->partition, ','))
+        assoc_rec.partition = job_desc->partition;
+
+    assoc_mgr_lock(&locks);
+
+    int pos = _license_tres_pos();
+    if (pos < 0) {
+        debug("limit_interactive: license/%s is not tracked", LICENSE_NAME);
+    } else if (assoc_mgr_fill_in_assoc(acct_db_conn, &assoc_rec, accounting_enforce, &assoc_ptr, true) != SLURM_SUCCESS) {
+        debug("limit_interactive: no association for uid %u", job_desc->user_id);
+        assoc_ptr = NULL;
+    }
+
+    for (; pos >= 0 && assoc_ptr; assoc_ptr = assoc_ptr->usage ? assoc_ptr->usage->parent_assoc_ptr : NULL) {
+        if (!assoc_ptr->grp_tres_ctld || !assoc_ptr->usage || !assoc_ptr->usage->grp_used_tres)
+            continue;
+        uint64_t limit = assoc_ptr->grp_tres_ctld[pos];
+        if (limit == INFINITE64 || limit == NO_VAL64)
+            continue;
+        uint64_t used = assoc_ptr->usage->grp_used_tres[pos];
+        if (used + nlic > limit) {
+            if (nlic > limit) {
+                *err_msg = xstrdup_printf("Interactive job needs %u %s licenses, but account %s is limited to %"PRIu64,
+                                          nlic, LICENSE_NAME, assoc_ptr->acct, limit);
+            } else {
+                *err_msg = xstrdup_printf("Interactive job limit reached (%"PRIu64" of %"PRIu64" %s licenses in use by account %s), "
+                                          "exit an existing interactive job or use sbatch",
+                                          used, limit, LICENSE_NAME, assoc_ptr->acct);
+            }
+            available = false;
+            break;
+        }
+    }
+
+    assoc_mgr_unlock(&locks);
+    return available;
+}
+
+/*
+  checks if the job is small enough for the warm pool: a single node, up to
+  pool_max_cpus cpus and pool_max_memory memory
+*/
+static bool _pool_eligible(struct job_descriptor *job_desc) {
+    if (job_desc->reservation || job_desc->req_nodes)
+        return false;
+    if (job_desc->min_nodes != NO_VAL && job_desc->min_nodes > 1)
+        return false;
+    if (job_desc->max_nodes != NO_VAL && job_desc->max_nodes > 1)
+        return false;
+
+    uint32_t cpus = 1;
+    if (job_desc->min_cpus != NO_VAL && job_desc->min_cpus > cpus)
+        cpus = job_desc->min_cpus;
+    if (job_desc->num_tasks != NO_VAL && job_desc->cpus_per_task != NO_VAL16 &&
+        job_desc->num_tasks * job_desc->cpus_per_task > cpus)
+        cpus = job_desc->num_tasks * job_desc->cpus_per_task;
+    if (cpus > pool_max_cpus)
+        return false;
+
+    if (pool_max_memory) {
+        // no memory request means the partition default, which isn't known
+        // here
+        if (job_desc->pn_min_memory == NO_VAL64)
+            return false;
+        uint64_t memory = job_desc->pn_min_memory;
+        if (memory & MEM_PER_CPU)
+            memory = (memory & ~MEM_PER_CPU) * cpus;
+        if (memory > pool_max_memory)
+            return false;
+    }
+
+    return true;
+}
+
+/* checks the pool reservation exists and has an idle node */
+static bool _pool_available(void) {
+    slurmctld_resv_t* resv_ptr = find_resv_name(pool_reservation);
+    if (!resv_ptr) {
+        debug("limit_interactive: pool reservation %s not found", pool_reservation);
+        return false;
+    }
+    if (!resv_ptr->node_bitmap || !idle_node_bitmap)
+        return false;
+    return bit_overlap(resv_ptr->node_bitmap, idle_node_bitmap) > 0;
+}
+
 extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid, char **err_msg) {
     // NOTE: no job id actually exists yet (=NO_VAL)
 
@@ -91,65 +473,80 @@ extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid, char
     // sbatch: argc = 0, script != NULL
 
     if (job_desc->script == NULL) {
+        if (submit_rate && job_desc->user_id != 0 && !_rate_take(job_desc->user_id)) {
+            info("limit_interactive: uid %u exceeded the interactive submit rate", job_desc->user_id);
+            *err_msg = xstrdup_printf("Too many interactive jobs submitted (limit is %u per minute), please wait a bit", submit_rate);
+            return SLURM_ERROR;
+        }
+
         info("limit_interactive: no script, adding interactive license");
 
         // also limit number of nodes
-        int nlic = 1;
-        if (job_desc->max_nodes > 1) {
+        if (max_interactive_nodes && job_desc->min_nodes != NO_VAL && job_desc->min_nodes > max_interactive_nodes) {
+            info("limit_interactive: %u nodes requested, limit is %u", job_desc->min_nodes, max_interactive_nodes);
+            *err_msg = xstrdup_printf("Interactive jobs are limited to %u nodes", max_interactive_nodes);
+            return ESLURM_INVALID_NODE_COUNT;
+        }
+
+        // small jobs go to the warm pool, if it has an idle node
+        bool pooled = pool_reservation && _pool_eligible(job_desc) && _pool_available();
+
+        uint32_t nlic;
+        if (pooled) {
+            nlic = 1;
+        } else if (job_desc->max_nodes == NO_VAL) {
+            // no node range requested (plain srun/salloc), only charge the
+            // requested nodes, a range is charged up to its maximum
+            nlic = (job_desc->min_nodes != NO_VAL) ? job_desc->min_nodes : 1;
+        } else {
             nlic = job_desc->max_nodes;
+            if (max_interactive_nodes && nlic > max_interactive_nodes) {
+                debug("limit_interactive: max_nodes %u limited to %u", nlic, max_interactive_nodes);
+                nlic = max_interactive_nodes;
+            }
         }
-        if (nlic > 9)
-            nlic = 9;
-        else if (nlic < 1)
+        if (nlic < 1)
             nlic = 1;
         job_desc->max_nodes = nlic;
-        char* licstr = xstrdup("interactive:1");
-        licstr[12] = ('0' + nlic);
+
+        char licbuf[32];
+        const char* licstr = _license_str(licbuf, sizeof(licbuf), nlic);
 
         if (limit_partition) {
+            _sync_partitions();
             if (job_desc->partition != NULL) {
                 xfree(job_desc->partition);
             }
-            job_desc->partition = xstrdup(limit_partition);
+            job_desc->partition = xstrdup(limit_parts ? limit_parts : limit_partition);
         }
 
-        char* tmp_str;
-        if (job_desc->licenses == NULL) {
-            job_desc->licenses = xstrdup(licstr);
-        } else {
-            bool have_license = false;
-            tmp_str = xstrdup(job_desc->licenses);
-            char *last;
-            char *token = strtok_r(tmp_str, ",;", &last);
-            while (token) {
-                if (strncmp(token, "interactive", 11) == 0) {
-                    uint32_t num = 1;
-                    for (int i = 0; token[i]; i++) {
-                        if (token[i] == ':') {
-                            token[i++] = '\0';
-                            char* end_num;
-                            num = (uint32_t)strtol(&token[i], &end_num,10);
-                        }
-                    }
-                    if (strcmp(token, "interactive") == 0 && num >= nlic) {
-                        have_license = true;
-                        break;
-                    }
-                }
-		token = strtok_r(NULL, ",;", &last);
-            }
-            xfree(tmp_str);
-
-            if (!have_license) {
-                tmp_str = xmalloc(strlen(job_desc->licenses) + 1 + 13 + 1);
-                strcpy(tmp_str, job_desc->licenses);
-                strcat(tmp_str, ",");
-                strcat(tmp_str, licstr);
-                xfree(job_desc->licenses);
-                job_desc->licenses = tmp_str;
-            }
+        uint32_t num = 0;
+        const char* token = NULL;
+        size_t token_len = 0;
+        int found = _find_license(job_desc->licenses, &num, &token, &token_len);
+        if (found < 0) {
+            info("limit_interactive: bad licenses %s", job_desc->licenses);
+            *err_msg = xstrdup_printf("Invalid %s license count in \"%s\"", LICENSE_NAME, job_desc->licenses);
+            return ESLURM_INVALID_LICENSES;
+        }
+        if (found && num > nlic) {
+            nlic = num;
+        }
+
+        if (check_limit && !_license_available(job_desc, nlic, err_msg)) {
+            info("limit_interactive: rejecting job of uid %u: %s", job_desc->user_id, *err_msg);
+            return ESLURM_ACCOUNTING_POLICY;
+        }
+
+        if (!found || num < nlic) {
+            _set_license(&job_desc->licenses, found ? token : NULL, token_len, licstr);
+        }
+
+        // the license is kept, so the pool doesn't bypass the limits
+        if (pooled) {
+            info("limit_interactive: using pool reservation %s", pool_reservation);
+            job_desc->reservation = xstrdup(pool_reservation);
         }
-        xfree(licstr);
     }
     return SLURM_SUCCESS;
 }
@@ -159,65 +556,72 @@ extern int job_modify(struct job_descriptor *job_desc, struct job_record *job_pt
     debug("limit_interactive: job_modify: licenses: %s -> %s", job_ptr->licenses, job_desc->licenses);
 
     // get current licenses
-    bool have_interactive = false;
+    uint32_t cur_lic = 0;
     if (job_ptr->license_list) {
-        have_interactive = license_get_total_cnt_from_list(job_ptr->license_list, "interactive") > 0;
+        cur_lic = license_get_total_cnt_from_list(job_ptr->license_list, LICENSE_NAME);
     }
-    if (!have_interactive) {
+    if (cur_lic == 0) {
         debug("limit_interactive: job_modify: not interactive, ignoring");
         return SLURM_SUCCESS;
     }
 
-    // for now, can't change anything on interactive jobs..
-    return ESLURM_NOT_SUPPORTED;
-
-    // for now, can't change max_nodes
-    if (job_desc->max_nodes != NO_VAL) {
+    // the licenses and partition of interactive jobs are set here
+    if (job_desc->licenses && xstrcmp(job_desc->licenses, job_ptr->licenses) != 0) {
+        info("limit_interactive: job_modify: job %u: can't change licenses of interactive job", job_ptr->job_id);
+        return ESLURM_NOT_SUPPORTED;
+    }
+    if (limit_partition && job_desc->partition && xstrcmp(job_desc->partition, job_ptr->partition) != 0) {
+        info("limit_interactive: job_modify: job %u: can't change partition of interactive job", job_ptr->job_id);
         return ESLURM_NOT_SUPPORTED;
     }
 
-    // add interactive to wanted licenses, if NULL, no change is needed
-    bool need_interactive = true;
-    if (job_desc->licenses) {
-        char *tmp_str = xstrdup(job_desc->licenses);
-        char *last;
-        char *token = strtok_r(tmp_str, ",;", &last);
-        while (token) {
-            if (strncmp(token, "interactive", 11) == 0) {
-                uint32_t num = 1;
-                for (int i = 0; token[i]; i++) {
-                    if (token[i] == ':') {
-                        token[i++] = '\0';
-                        char* end_num;
-                        num = (uint32_t)strtol(&token[i], &end_num,10);
-                    }
-                }
-                if (strcmp(token, "interactive") == 0 && num > 0) {
-                    need_interactive = false;
-                    break;
-                }
-            }
-            token = strtok_r(NULL, ",;", &last);
+    // running jobs: the licenses can't follow a resize (slurmctld applies it,
+    // and its accounting, only after job_modify()), so the node count can't
+    // be changed
+    if (!IS_JOB_PENDING(job_ptr)) {
+        if (job_desc->min_nodes != NO_VAL || job_desc->max_nodes != NO_VAL) {
+            info("limit_interactive: job_modify: job %u: can't change nodes of running interactive job", job_ptr->job_id);
+            return ESLURM_NOT_SUPPORTED;
         }
-        xfree(tmp_str);
+        return SLURM_SUCCESS;
+    }
 
-        if (need_interactive) {
-            // for now, just fail
-            return ESLURM_NOT_SUPPORTED;
+    // pending jobs: the number of nodes can only be lowered, and the
+    // licenses are updated with the rest of the job
+    if (job_desc->min_nodes != NO_VAL && job_desc->min_nodes > cur_lic) {
+        info("limit_interactive: job_modify: job %u: can't increase nodes (%u -> %u)", job_ptr->job_id, cur_lic, job_desc->min_nodes);
+        return ESLURM_NOT_SUPPORTED;
+    }
+    uint32_t new_nodes = (job_desc->max_nodes != NO_VAL) ? job_desc->max_nodes : job_desc->min_nodes;
+    if (new_nodes == NO_VAL || new_nodes == cur_lic) {
+        return SLURM_SUCCESS;
+    }
+    if (new_nodes > cur_lic) {
+        info("limit_interactive: job_modify: job %u: can't increase nodes (%u -> %u)", job_ptr->job_id, cur_lic, new_nodes);
+        return ESLURM_NOT_SUPPORTED;
+    }
 
-            tmp_str = xmalloc(strlen(job_desc->licenses) + 1 + 13 + 1);
-            strcpy(tmp_str, job_desc->licenses);
-            strcat(tmp_str, ",interactive:1");
-            info("limit_interactive: job_modify: licenses: %s -> (%s -> %s)", job_ptr->licenses, job_desc->licenses, tmp_str);
-            xfree(job_desc->licenses);
-            job_desc->licenses = tmp_str;
-        }
+    uint32_t nlic = new_nodes ? new_nodes : 1;
+    char licbuf[32];
+    const char* licstr = _license_str(licbuf, sizeof(licbuf), nlic);
+
+    uint32_t num = 0;
+    const char* token = NULL;
+    size_t token_len = 0;
+    char* licenses = xstrdup(job_ptr->licenses);
+    if (_find_license(licenses, &num, &token, &token_len) <= 0) {
+        xfree(licenses);
+        return ESLURM_NOT_SUPPORTED;
     }
+    _set_license(&licenses, token, token_len, licstr);
+    info("limit_interactive: job_modify: job %u: licenses %s -> %s", job_ptr->job_id, job_ptr->licenses, licenses);
+
+    xfree(job_desc->licenses);
+    job_desc->licenses = licenses;
 
     return SLURM_SUCCESS;
 }
 
-
 /* Find a license_t record by license name (for use by list_find_first), also
    from slurmctld/licenses.c */
 static int _license_find_rec(void *x, void *key)
@@ -31,6 +31,8 @@
 
 #include "src/common/xstring.h"
 
+#include "partition_set.h"
+
 const char plugin_name[]="Meta partitions";
 const char plugin_type[]="job_submit/meta_partitions";
 const uint32_t plugin_version = SLURM_VERSION_NUMBER;
@@ -50,6 +52,69 @@ static s_p_options_t meta_partitions_options[] = {
 int meta_count = 0;
 char** meta_keys = NULL;
 char** meta_values = NULL;
+// meta_values without unknown partitions and duplicates, rebuilt on
+// part_list changes
+char** meta_parts = NULL;
+// meta_keys -> index
+name_index_t meta_index;
+
+/* length of the first element of the comma separated list */
+inline static size_t _element_len(const char* list) {
+    return strcspn(list, ",");
+}
+
+/*
+  replaces the meta partitions in meta_values[i] with their (flattened)
+  partitions, depth first. A meta referencing itself refers to the real
+  partition with the same name. Other cycles are fatal.
+  state: 0 - not visited, 1 - in progress, 2 - flattened
+*/
+static void _flatten_meta(int i, int* state) {
+    if (state[i] == 2)
+        return;
+    if (state[i] == 1)
+        fatal("job_submit/meta_partitions: MetaPartition %s is part of a cycle", meta_keys[i]);
+    state[i] = 1;
+
+    char* partitions = NULL;
+    name_index_t seen;
+    name_index_init(&seen, 8);
+
+    for (const char* p = meta_values[i]; *p; ) {
+        size_t len = _element_len(p);
+        int meta = len ? name_index_get(&meta_index, p, len) : -1;
+        const char* sub = p;
+        size_t sub_len = len;
+        if (meta >= 0 && meta != i) {
+            _flatten_meta(meta, state);
+            sub = meta_values[meta];
+            sub_len = strlen(sub);
+        }
+        // append the elements of sub (either the partition itself, or the
+        // flattened meta)
+        for (const char* q = sub; q < sub + sub_len; ) {
+            size_t qlen = _element_len(q);
+            if (qlen > (size_t)(sub + sub_len - q))
+                qlen = sub + sub_len - q;
+            if (qlen && name_index_add(&seen, q, qlen, 0)) {
+                if (partitions)
+                    xstrcat(partitions, ",");
+                xstrncat(partitions, q, qlen);
+            }
+            q += qlen + 1;
+        }
+        p += len;
+        if (*p)
+            p++;
+    }
+
+    name_index_free(&seen);
+    if (partitions && strcmp(partitions, meta_values[i]) != 0)
+        debug("job_submit/meta_partitions: %s: %s -> %s", meta_keys[i], meta_values[i], partitions);
+    xfree(meta_values[i]);
+    meta_values[i] = partitions ? partitions : xstrdup("");
+    state[i] = 2;
+}
 
 extern int init (void) {
 
@@ -76,14 +141,20 @@ extern int init (void) {
 
     meta_keys = xmalloc(meta_count * sizeof(char*));
     meta_values = xmalloc(meta_count * sizeof(char*));
-    
+    meta_parts = xmalloc(meta_count * sizeof(char*));
+    name_index_init(&meta_index, meta_count);
+
     for (int i = 0; i < meta_count; i++) {
         char* metapartition;
         char* partitions;
         s_p_get_string(&metapartition, "MetaPartition", metas[i]);
-        s_p_get_string(&partitions, "Partitions", metas[i]);
+        if (!s_p_get_string(&partitions, "Partitions", metas[i]))
+            fatal("job_submit/meta_partitions: MetaPartition %s without Partitions", metapartition);
         meta_keys[i] = metapartition;
         meta_values[i] = partitions;
+        if (!name_index_add(&meta_index, metapartition, strlen(metapartition), i)) {
+            error("job_submit/meta_partitions: MetaPartition %s appears more than once, using the first", metapartition);
+        }
         if (strlen(buffer) < sizeof(buffer) - 1) {
             if (buffer[0])
                 strcat(buffer, ",");
@@ -93,7 +164,16 @@ extern int init (void) {
 
     info("job_submit/meta_partitions: found %i meta partitions (%s)", meta_count, buffer);
 
-    // FIXME, validate somehow?
+    // metas can contain other metas, flatten them now so there's a single
+    // level on submit
+    int* state = xmalloc(meta_count * sizeof(int));
+    for (int i = 0; i < meta_count; i++) {
+        _flatten_meta(i, state);
+    }
+    xfree(state);
+
+    // part_list isn't necessarily loaded yet, the leaves are validated on
+    // first use (and whenever part_list changes), see _sync_partitions()
 
     s_p_hashtbl_destroy(options);
     options = NULL;
@@ -108,24 +188,98 @@ extern int fini (void) {
         meta_keys[i] = NULL;
         xfree(meta_values[i]);
         meta_values[i] = NULL;
+        xfree(meta_parts[i]);
     }
     xfree(meta_keys);
     xfree(meta_values);
+    xfree(meta_parts);
+    name_index_free(&meta_index);
     meta_count = 0;
+    part_registry_fini();
     return SLURM_SUCCESS;
 }
 
+/*
+  appends the partition "name" (of length len) to *partitions, unless already
+  there. Existing partitions are tracked by id in "seen", others by name in
+  "others".
+*/
+static void _add_partition(char** partitions, const char* name, size_t len, bitstr_t* seen, name_index_t* others) {
+    int id = part_registry_id(name, len);
+    if (id >= 0) {
+        if (bit_test(seen, id))
+            return;
+        bit_set(seen, id);
+    } else if (!name_index_add(others, name, len, 0)) {
+        return;
+    }
+    if (*partitions)
+        xstrcat(*partitions, ",");
+    xstrncat(*partitions, name, len);
+}
+
+/* rebuild meta_parts if the partitions changed */
+static void _sync_partitions(void) {
+    if (!part_registry_sync())
+        return;
+
+    for (int i = 0; i < meta_count; i++) {
+        xfree(meta_parts[i]);
+        meta_parts[i] = part_set_normalize(meta_values[i], "job_submit/meta_partitions");
+        if (meta_parts[i] == NULL) {
+            error("job_submit/meta_partitions: no valid partitions for %s", meta_keys[i]);
+        }
+    }
+}
+
+/*
+  replaces each meta partition in the job's partitions with its partitions,
+  removing duplicates (keeping the first)
+*/
 static int _update_partition(struct job_descriptor *job_desc) {
-    if (job_desc->partition) {
-        for (int i = 0; i < meta_count; i++) {
-            if (strcmp(meta_keys[i], job_desc->partition) == 0) {
-                info("meta_partitions: job %i, %s -> %s", job_desc->job_id, job_desc->partition, meta_values[i]);
-                xfree(job_desc->partition);
-                job_desc->partition = xstrdup(meta_values[i]);
+    if (!job_desc->partition)
+        return SLURM_SUCCESS;
+
+    _sync_partitions();
+
+    char* partitions = NULL;
+    bitstr_t* seen = part_set_alloc();
+    name_index_t others;
+    name_index_init(&others, 4);
+
+    for (const char* p = job_desc->partition; *p; ) {
+        size_t len = _element_len(p);
+        int meta = len ? name_index_get(&meta_index, p, len) : -1;
+        if (meta >= 0) {
+            // keep the configured value if nothing is valid, so slurm will
+            // reject it properly
+            const char* metap = meta_parts[meta] ? meta_parts[meta] : meta_values[meta];
+            for (; *metap; ) {
+                size_t mlen = _element_len(metap);
+                if (mlen)
+                    _add_partition(&partitions, metap, mlen, seen, &others);
+                metap += mlen;
+                if (*metap)
+                    metap++;
             }
+        } else if (len) {
+            _add_partition(&partitions, p, len, seen, &others);
         }
+        p += len;
+        if (*p)
+            p++;
+    }
+
+    if (partitions && strcmp(partitions, job_desc->partition) != 0) {
+        info("meta_partitions: job %i, %s -> %s", job_desc->job_id, job_desc->partition, partitions);
+        xfree(job_desc->partition);
+        job_desc->partition = partitions;
+    } else {
+        xfree(partitions);
     }
 
+    name_index_free(&others);
+    part_set_free(&seen);
     return SLURM_SUCCESS;
 }
 
@@ -0,0 +1,428 @@
+/******************************************************************************
+ *
+ *   job_submit_replay.c
+ *
+ *   Copyright (C) 2026 Hebrew University of Jerusalem Israel, see
+ *   LICENSE file.
+ *
+ *   Author: Yair Yarom <irush@cs.huji.ac.il>
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc., 59
+ *   Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ *****************************************************************************/
+
+/*
+  Replays a capture of job_submit_info (Format=binary) through job_submit
+  plugins, outside of slurmctld.
+
+  The plugins are loaded in the given order and each record goes through
+  them as in slurmctld (JobSubmitPlugins), stopping at the first rejection.
+  For each plugin the time of the job_submit() calls is measured, and the
+  records it changed (and rejected) are counted, optionally printing the
+  differences.
+
+  The plugins run against an empty slurmctld: no jobs, no reservations, no
+  associations, and only the partitions given with -P. The plugin
+  configuration files are read from the directory of $SLURM_CONF as usual.
+
+  This links with libslurmfull (for xmalloc, bitstring, list, etc. which the
+  plugins use), and defines the slurmctld globals the plugins reference.
+*/
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <slurm/slurm.h>
+#include <slurm/slurm_errno.h>
+
+#include "src/slurmctld/slurmctld.h"
+#include "src/slurmctld/reservation.h"
+#include "src/common/list.h"
+#include "src/common/log.h"
+#include "src/common/xmalloc.h"
+#include "src/common/xstring.h"
+
+#include "job_capture.h"
+
+#if SLURM_VERSION_NUMBER < SLURM_VERSION_NUM(20,2,0)
+typedef struct part_record replay_part_t;
+#else
+typedef part_record_t replay_part_t;
+#endif
+
+/* slurmctld globals used by the plugins */
+List part_list = NULL;
+time_t last_part_update = 0;
+char* default_part_name = NULL;
+void* acct_db_conn = NULL;
+int accounting_enforce = 0;
+bitstr_t* idle_node_bitmap = NULL;
+
+/* no reservations */
+extern slurmctld_resv_t* find_resv_name(char* resv_name) {
+    return NULL;
+}
+
+typedef int (*init_fn_t)(void);
+typedef int (*job_submit_fn_t)(job_desc_msg_t* job_desc, uint32_t submit_uid, char** err_msg);
+
+typedef struct plugin {
+    const char* path;
+    void* handle;
+    init_fn_t init;
+    init_fn_t fini;
+    job_submit_fn_t job_submit;
+    uint64_t* latencies;    // ns, per call
+    uint64_t calls;
+    uint64_t changed;
+    uint64_t rejected;
+} plugin_t;
+
+static int plugin_count = 0;
+static plugin_t* plugins = NULL;
+static double rate = 0;         // records per second, 0 as fast as possible
+static uint64_t max_records = 0;
+static bool show_diff = false;
+
+static void _usage(const char* prog) {
+    fprintf(stderr, "usage: %s [-r <rate>] [-n <records>] [-P <partitions>] [-d] [-v] <capture> <plugin.so>...\n", prog);
+    fprintf(stderr, "  -r <rate>        records per second (default as fast as possible)\n");
+    fprintf(stderr, "  -n <records>     replay only the first <records> records\n");
+    fprintf(stderr, "  -P <partitions>  comma separated partitions to create, the first is the default\n");
+    fprintf(stderr, "  -d               print the changes each plugin made\n");
+    fprintf(stderr, "  -v               more verbose slurm logging (repeatable)\n");
+    exit(2);
+}
+
+static uint64_t _now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void _create_partitions(const char* names) {
+    part_list = list_create(NULL);
+    char* tmp_str = xstrdup(names);
+    char* last;
+    char* token = strtok_r(tmp_str, ",", &last);
+    while (token) {
+        replay_part_t* part_ptr = xmalloc(sizeof(replay_part_t));
+        part_ptr->name = xstrdup(token);
+        part_ptr->state_up = PARTITION_UP;
+        part_ptr->max_time = INFINITE;
+        part_ptr->max_nodes = INFINITE;
+        list_append(part_list, part_ptr);
+        if (!default_part_name)
+            default_part_name = xstrdup(token);
+        token = strtok_r(NULL, ",", &last);
+    }
+    xfree(tmp_str);
+    last_part_update = time(NULL);
+}
+
+static void _load_plugin(plugin_t* plugin, const char* path, uint64_t records) {
+    plugin->path = path;
+    // lazy, the plugins reference slurmctld functions which are only
+    // resolved if called
+    plugin->handle = dlopen(path, RTLD_LAZY | RTLD_LOCAL);
+    if (!plugin->handle) {
+        fprintf(stderr, "can't load %s: %s\n", path, dlerror());
+        exit(2);
+    }
+    plugin->init = (init_fn_t) dlsym(plugin->handle, "init");
+    plugin->fini = (init_fn_t) dlsym(plugin->handle, "fini");
+    plugin->job_submit = (job_submit_fn_t) dlsym(plugin->handle, "job_submit");
+    if (!plugin->job_submit) {
+        fprintf(stderr, "%s has no job_submit()\n", path);
+        exit(2);
+    }
+    if (plugin->init && plugin->init() != SLURM_SUCCESS) {
+        fprintf(stderr, "%s: init() failed\n", path);
+        exit(2);
+    }
+    plugin->latencies = xmalloc(records * sizeof(uint64_t));
+}
+
+static void _print_num(const char* member, size_t size) {
+    uint64_t value = 0;
+    switch (size) {
+    case 1: value = *(const uint8_t*)member; break;
+    case 2: value = *(const uint16_t*)member; break;
+    case 4: value = *(const uint32_t*)member; break;
+    case 8: value = *(const uint64_t*)member; break;
+    }
+    printf("%"PRIu64, value);
+}
+
+/* prints the fields which differ between before and after */
+static void _print_diff(uint64_t record, const plugin_t* plugin, const job_desc_msg_t* before, const job_desc_msg_t* after) {
+    for (size_t i = 0; i < JOB_CAPTURE_NFIELDS; i++) {
+        const job_capture_field_t* field = &job_capture_fields[i];
+        const char* b = (const char*)before + field->offset;
+        const char* a = (const char*)after + field->offset;
+        switch (field->kind) {
+        case JOB_CAPTURE_NUM:
+            if (memcmp(b, a, field->size) != 0) {
+                printf("record %"PRIu64" %s: %s: ", record, plugin->path, field->name);
+                _print_num(b, field->size);
+                printf(" -> ");
+                _print_num(a, field->size);
+                printf("\n");
+            }
+            break;
+        case JOB_CAPTURE_STR: {
+            const char* bs = *(char* const*)b;
+            const char* as = *(char* const*)a;
+            if (xstrcmp(bs, as) != 0)
+                printf("record %"PRIu64" %s: %s: %s -> %s\n", record, plugin->path, field->name,
+                       bs ? bs : "(null)", as ? as : "(null)");
+            break;
+        }
+        case JOB_CAPTURE_ARRAY: {
+            char* const* ba = *(char* const* const*)b;
+            char* const* aa = *(char* const* const*)a;
+            uint32_t bc = *(const uint32_t*)((const char*)before + field->count_offset);
+            uint32_t ac = *(const uint32_t*)((const char*)after + field->count_offset);
+            for (uint32_t j = 0; j < MAX(bc, ac); j++) {
+                const char* bs = (ba && j < bc) ? ba[j] : NULL;
+                const char* as = (aa && j < ac) ? aa[j] : NULL;
+                if (xstrcmp(bs, as) != 0)
+                    printf("record %"PRIu64" %s: %s[%u]: %s -> %s\n", record, plugin->path, field->name, j,
+                           bs ? bs : "(null)", as ? as : "(null)");
+            }
+            break;
+        }
+        }
+    }
+}
+
+static job_desc_msg_t* _decode(const char* rec, const job_capture_rec_hdr_t* hdr) {
+    job_desc_msg_t* job_desc = xmalloc(sizeof(job_desc_msg_t));
+    slurm_init_job_desc_msg(job_desc);
+    if (!job_capture_decode(rec, hdr, job_desc)) {
+        slurm_free_job_desc_msg(job_desc);
+        return NULL;
+    }
+    return job_desc;
+}
+
+/* runs the record through the plugins, returns false if it's malformed */
+static bool _replay(uint64_t record, const char* rec, const job_capture_rec_hdr_t* hdr,
+                    job_capture_buf_t* buf_before, job_capture_buf_t* buf_after) {
+    job_desc_msg_t* job_desc = _decode(rec, hdr);
+    if (!job_desc)
+        return false;
+
+    for (int i = 0; i < plugin_count; i++) {
+        plugin_t* plugin = &plugins[i];
+        char* err_msg = NULL;
+
+        job_capture_begin(buf_before, JOB_CAPTURE_SUBMIT, 0, 0);
+        job_capture_encode(buf_before, job_desc);
+        job_capture_end(buf_before);
+
+        uint64_t start = _now_ns();
+        int rc = plugin->job_submit(job_desc, hdr->submit_uid, &err_msg);
+        plugin->latencies[plugin->calls++] = _now_ns() - start;
+
+        job_capture_begin(buf_after, JOB_CAPTURE_SUBMIT, 0, 0);
+        job_capture_encode(buf_after, job_desc);
+        job_capture_end(buf_after);
+
+        if (buf_before->len != buf_after->len || memcmp(buf_before->data, buf_after->data, buf_before->len) != 0) {
+            plugin->changed++;
+            if (show_diff) {
+                job_capture_rec_hdr_t before_hdr;
+                memcpy(&before_hdr, buf_before->data, sizeof(before_hdr));
+                job_desc_msg_t* before = _decode(buf_before->data, &before_hdr);
+                _print_diff(record, plugin, before, job_desc);
+                slurm_free_job_desc_msg(before);
+            }
+        }
+
+        if (rc != SLURM_SUCCESS) {
+            plugin->rejected++;
+            if (show_diff)
+                printf("record %"PRIu64" %s: rejected: %s (%s)\n", record, plugin->path,
+                       slurm_strerror(rc), err_msg ? err_msg : "");
+            xfree(err_msg);
+            break;
+        }
+        xfree(err_msg);
+    }
+
+    slurm_free_job_desc_msg(job_desc);
+    return true;
+}
+
+static int _cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void _report(const plugin_t* plugin) {
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < plugin->calls; i++)
+        total += plugin->latencies[i];
+    qsort(plugin->latencies, plugin->calls, sizeof(uint64_t), _cmp_u64);
+
+    printf("%s: calls=%"PRIu64" changed=%"PRIu64" rejected=%"PRIu64, plugin->path,
+           plugin->calls, plugin->changed, plugin->rejected);
+    if (plugin->calls) {
+        printf(" throughput=%.0f/s p50=%.1fus p90=%.1fus p99=%.1fus max=%.1fus",
+               total ? plugin->calls * 1e9 / total : 0.0,
+               plugin->latencies[plugin->calls * 50 / 100] / 1e3,
+               plugin->latencies[plugin->calls * 90 / 100] / 1e3,
+               plugin->latencies[plugin->calls * 99 / 100] / 1e3,
+               plugin->latencies[plugin->calls - 1] / 1e3);
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    const char* partitions = "";
+    int verbose = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:n:P:dvh")) != -1) {
+        switch (opt) {
+        case 'r':
+            rate = strtod(optarg, NULL);
+            break;
+        case 'n':
+            max_records = strtoull(optarg, NULL, 10);
+            break;
+        case 'P':
+            partitions = optarg;
+            break;
+        case 'd':
+            show_diff = true;
+            break;
+        case 'v':
+            verbose++;
+            break;
+        default:
+            _usage(argv[0]);
+        }
+    }
+    if (argc - optind < 2)
+        _usage(argv[0]);
+
+    log_options_t log_opts = LOG_OPTS_STDERR_ONLY;
+    log_opts.stderr_level = LOG_LEVEL_ERROR + verbose;
+    log_init(argv[0], log_opts, 0, NULL);
+
+    // the capture
+    const char* capture = argv[optind];
+    int fd = open(capture, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(capture);
+        return 2;
+    }
+    if ((size_t)st.st_size < sizeof(job_capture_file_hdr_t)) {
+        fprintf(stderr, "%s: not a capture file\n", capture);
+        return 2;
+    }
+    const char* base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) {
+        perror(capture);
+        return 2;
+    }
+    close(fd);
+    job_capture_file_hdr_t file_hdr;
+    memcpy(&file_hdr, base, sizeof(file_hdr));
+    if (memcmp(file_hdr.magic, JOB_CAPTURE_MAGIC, sizeof(file_hdr.magic)) != 0 ||
+        file_hdr.version != JOB_CAPTURE_VERSION) {
+        fprintf(stderr, "%s: not a capture file (or an unsupported version)\n", capture);
+        return 2;
+    }
+    if (file_hdr.slurm_version != SLURM_VERSION_NUMBER)
+        fprintf(stderr, "%s: captured with another slurm version, fields may be missing\n", capture);
+
+    // count the records, for the latencies
+    uint64_t records = 0;
+    uint64_t dropped = 0;
+    size_t pos = sizeof(file_hdr);
+    job_capture_rec_hdr_t hdr;
+    const char* rec;
+    while ((rec = job_capture_next(base, st.st_size, &pos, &hdr))) {
+        if (hdr.type == JOB_CAPTURE_SUBMIT)
+            records++;
+        if (max_records && records == max_records)
+            break;
+    }
+
+    _create_partitions(partitions);
+    plugin_count = argc - optind - 1;
+    plugins = xmalloc(plugin_count * sizeof(plugin_t));
+    for (int i = 0; i < plugin_count; i++)
+        _load_plugin(&plugins[i], argv[optind + 1 + i], records);
+
+    job_capture_buf_t buf_before = { NULL, 0, 0 };
+    job_capture_buf_t buf_after = { NULL, 0, 0 };
+    uint64_t replayed = 0;
+    uint64_t malformed = 0;
+    uint64_t start = _now_ns();
+    pos = sizeof(file_hdr);
+    while (replayed < records && (rec = job_capture_next(base, st.st_size, &pos, &hdr))) {
+        if (hdr.type == JOB_CAPTURE_DROPPED) {
+            uint64_t n = 0;
+            if (hdr.len >= sizeof(hdr) + sizeof(job_capture_field_hdr_t) + sizeof(n))
+                memcpy(&n, rec + sizeof(hdr) + sizeof(job_capture_field_hdr_t), sizeof(n));
+            dropped += n;
+            continue;
+        }
+        if (hdr.type != JOB_CAPTURE_SUBMIT)
+            continue;
+
+        if (rate > 0) {
+            uint64_t due = start + (uint64_t)(replayed * 1e9 / rate);
+            uint64_t now = _now_ns();
+            if (due > now) {
+                struct timespec ts = { (due - now) / 1000000000, (due - now) % 1000000000 };
+                nanosleep(&ts, NULL);
+            }
+        }
+        if (!_replay(replayed, rec, &hdr, &buf_before, &buf_after))
+            malformed++;
+        replayed++;
+    }
+    double elapsed = (_now_ns() - start) / 1e9;
+
+    printf("records=%"PRIu64" malformed=%"PRIu64" dropped_in_capture=%"PRIu64" elapsed=%.3fs\n",
+           replayed, malformed, dropped, elapsed);
+    for (int i = 0; i < plugin_count; i++) {
+        _report(&plugins[i]);
+        if (plugins[i].fini)
+            plugins[i].fini();
+        xfree(plugins[i].latencies);
+    }
+
+    xfree(buf_before.data);
+    xfree(buf_after.data);
+    munmap((void*)base, st.st_size);
+    return 0;
+}
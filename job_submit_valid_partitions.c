@@ -52,6 +52,8 @@
 #include "src/slurmctld/slurmctld.h"
 #include "src/common/assoc_mgr.h"
 
+#include "partition_set.h"
+
 /*
  * These variables are required by the generic plugin interface.  If they
  * are not found in the plugin, the plugin loader will ignore it.
@@ -90,7 +92,7 @@ static s_p_options_t valid_partitions_options[] = {
 
 bool force_valid = false;
 char* exclude = NULL;
-char** excludes = NULL;
+bitstr_t* exclude_set = NULL;
 
 extern int init (void) {
 
@@ -113,34 +115,6 @@ extern int init (void) {
 	s_p_get_boolean(&force_valid, "Force", options);
 	s_p_get_string(&exclude, "Exclude", options);
 
-	if (exclude) {
-		char* p;
-		char* saveptr;
-
-		/* count partitions */
-		int n_exclude = 1;
-		for (p = exclude; *p; ++p) {
-			if (*p == ',') {
-				++n_exclude;
-			}
-		}
-
-		/* build excludes array */
-		excludes = xmalloc(sizeof(char*) * (n_exclude + 1));
-		char* tmp_str = xstrdup(exclude);
-		char* part = strtok_r(tmp_str, ",", &saveptr);
-		int i = 0;
-		while (part) {
-			excludes[i++] = xstrdup(part);
-			part = strtok_r(NULL, ",", &saveptr);
-		}
-		excludes[i] = NULL;
-		debug("job_submit/valid_partitions: %i partitions excluded", n_exclude);
-
-		xfree(tmp_str);
-	}
-
-
 	xfree(conf_file);
 
 	debug("job_submit/valid_partitions: force=%i", force_valid);
@@ -157,65 +131,59 @@ extern int init (void) {
 extern int fini (void) {
     xfree(exclude);
     exclude = NULL;
-    if (excludes) {
-	    for (int i = 0; excludes[i]; i++) {
-		    xfree(excludes[i]);
-		    excludes[i] = 0;
-	    }
-	    xfree(excludes);
-    }
+    part_set_free(&exclude_set);
+    part_registry_fini();
     return SLURM_SUCCESS;
 }
 
+/* rebuild the exclude set if the partitions changed */
+static void _sync_partitions(void) {
+	if (!part_registry_sync() && (exclude_set || !exclude))
+		return;
+
+	part_set_free(&exclude_set);
+	if (exclude) {
+		const char* unknown = NULL;
+		size_t unknown_len = 0;
+		exclude_set = part_set_alloc();
+		if (part_set_add_str(exclude_set, exclude, &unknown, &unknown_len))
+			debug("job_submit/valid_partitions: excluded partition %.*s doesn't exist", (int)unknown_len, unknown);
+	}
+}
+
 /* Set a job's default partition to all partitions in the cluster */
 extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid,
                       char **err_msg)
 {
 	/* Locks: Read partition */
-	ListIterator part_iterator;
-#if SLURM_VERSION_NUMBER < SLURM_VERSION_NUM(20,2,0)
-	struct part_record *part_ptr;
-#else
-	part_record_t *part_ptr;
-#endif
+	part_set_part_t *part_ptr;
 	const char* account = NULL;
 	slurmdb_user_rec_t user;
 	int i;
-	char** reqpart = NULL;
-	int n_reqpart = 0;
+	bitstr_t* candidates = NULL;
+
+	_sync_partitions();
 
 	/* job already specified partition */
 	if (job_desc->partition) {
-		/* if force, save the requested partitions, and clear it */
+		/* if force, filter the requested partitions, and clear it */
 		if (force_valid) {
-			char* p;
-			char* saveptr;
-
-			/* count partitions */
-			n_reqpart = 1;
-			for (p = job_desc->partition; *p; ++p) {
-				if (*p == ',') {
-					++n_reqpart;
-				}
-			}
-
-			/* build reqpart array */
-			reqpart = xmalloc(sizeof(char*) * n_reqpart);
-			char* tmp_str = xstrdup(job_desc->partition);
-			char* part = strtok_r(tmp_str, ",", &saveptr);
-			i = 0;
-			while (part) {
-				reqpart[i++] = xstrdup(part);
-				part = strtok_r(NULL, ",", &saveptr);
-			}
-			debug("job_submit/valid_partitions: %i partitions requested", n_reqpart);
+			candidates = part_set_alloc();
+			part_set_add_str(candidates, job_desc->partition, NULL, NULL);
+			debug("job_submit/valid_partitions: %"PRId64" partitions requested", (int64_t)bit_set_count(candidates));
 
-			xfree(tmp_str);
 			xfree(job_desc->partition);
 			job_desc->partition = NULL;
 		} else {
 			return SLURM_SUCCESS;
 		}
+	} else {
+		/* all partitions, except the excluded ones (if not
+		 * specifically requested) */
+		candidates = part_set_alloc();
+		part_set_fill(candidates);
+		if (exclude_set)
+			part_set_subtract(candidates, exclude_set);
 	}
 
 	/* Get account or default account */
@@ -233,43 +201,15 @@ extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid,
 		}
 	}
 
-	part_iterator = list_iterator_create(part_list);
-#if SLURM_VERSION_NUMBER < SLURM_VERSION_NUM(20,2,0)
-	while ((part_ptr = (struct part_record *) list_next(part_iterator))) {
-#else
-	while ((part_ptr = (part_record_t *) list_next(part_iterator))) {
-#endif
-		if (force_valid && n_reqpart) {
-			bool found = false;
-			for (i = 0; i < n_reqpart; ++i) {
-				if (strcmp(reqpart[i], part_ptr->name) == 0) {
-					found = true;
-					break;
-				}
-			}
-			if (!found) {
-				debug("job_submit/valid_partitions: job didn't request partition %s", part_ptr->name);
-				continue;
-			}
-		} else {
-			/* exclude if not specifically reqeusted */
-			if (exclude) {
-				bool found = false;
-				for (i = 0; excludes[i]; ++i) {
-					if (strcmp(excludes[i], part_ptr->name) == 0) {
-						found = true;
-						break;
-					}
-				}
-				if (found) {
-					debug("job_submit/valid_partitions: partition %s is excluded", part_ptr->name);
-					continue;
-				}
-			}
-		}
+	for (int id = 0; id < part_registry.count; id++) {
+		if (!bit_test(candidates, id))
+			continue;
+		part_ptr = part_registry.parts[id];
 
-		if (!(part_ptr->state_up & PARTITION_SUBMIT))
+		if (!(part_ptr->state_up & PARTITION_SUBMIT)) {
+			bit_clear(candidates, id);
 			continue;	/* nobody can submit jobs here */
+		}
 
 		/* Check if in AllowAccounts */
 		if (account && part_ptr->allow_accounts) {
@@ -279,6 +219,7 @@ extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid,
 			}
 			if (!part_ptr->allow_account_array[i]) {
 				debug("job_submit/valid_partitions: job account %s not allowed in %s", account, part_ptr->name);
+				bit_clear(candidates, id);
 				continue;
 			}
 		}
@@ -291,6 +232,7 @@ extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid,
 			}
 			if (part_ptr->deny_account_array[i]) {
 				debug("job_submit/valid_partitions: job account %s denied in %s", account, part_ptr->name);
+				bit_clear(candidates, id);
 				continue;
 			}
 		}
@@ -299,23 +241,15 @@ extern int job_submit(struct job_descriptor *job_desc, uint32_t submit_uid,
 		if (part_ptr->max_time != INFINITE && job_desc->time_limit != NO_VAL) {
 			if (job_desc->time_limit == INFINITE || job_desc->time_limit > part_ptr->max_time) {
 				debug("job_submit/valid_partitions: job limit %u > partition %s limit %u", job_desc->time_limit, part_ptr->name, part_ptr->max_time);
+				bit_clear(candidates, id);
 				continue;
 			}
 		}
-
-		if (job_desc->partition)
-			xstrcat(job_desc->partition, ",");
-		xstrcat(job_desc->partition, part_ptr->name);
 	}
-	list_iterator_destroy(part_iterator);
-        info("job_submit/valid_partitions: job partitions set to: %s", job_desc->partition);
 
-	if (reqpart) {
-		for (i = 0; i < n_reqpart; i++)
-			xfree(reqpart[i]);
-		xfree(reqpart);
-		reqpart = NULL;
-	}
+	job_desc->partition = part_set_to_str(candidates);
+	part_set_free(&candidates);
+        info("job_submit/valid_partitions: job partitions set to: %s", job_desc->partition);
 
 	/*
 	 * If job_desc->partition is empty, than even the default partition is not
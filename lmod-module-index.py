@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+
+# Builds the module index used by spank_lmod (index=<path>) to check --module
+# on the submission side, from Lmod's spider. Run from cron (or whenever the
+# module tree changes) on a host with Lmod, e.g.:
+#
+#   lmod-module-index.py -o /etc/slurm/lmod-module-index $MODULEPATH
+#
+# The index is a header line followed by lines sorted (in byte order) by key:
+#   <name>\t<default full name>\t
+#   <full name>\t\t<conflicting modules, comma separated>
+# It is replaced atomically, so it can be rebuilt while jobs are submitted.
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+HEADER = "# spank_lmod module index 1\n"
+
+
+def version_key(version):
+    # lmod like ordering: numbers numerically, the rest as strings
+    return [(0, int(part), "") if part.isdigit() else (1, 0, part)
+            for part in re.findall(r"\d+|[^\d.]+", version)]
+
+
+def spider(modulepath):
+    lmod_dir = os.environ.get("LMOD_DIR")
+    if not lmod_dir:
+        sys.exit("LMOD_DIR isn't set, is lmod initialized?")
+    cmd = [os.path.join(lmod_dir, "spider"), "-o", "jsonSoftwarePage", ":".join(modulepath)]
+    return json.loads(subprocess.run(cmd, check=True, stdout=subprocess.PIPE).stdout)
+
+
+def conflicts(path):
+    # conflict("a", "b/1") in lua modulefiles, "conflict a b/1" in tcl ones
+    try:
+        with open(path, errors="replace") as f:
+            text = f.read()
+    except OSError:
+        return []
+    names = []
+    for args in re.findall(r"^\s*conflict\s*\((.*?)\)", text, re.M):
+        names += re.findall(r"[\"']([^\"']+)[\"']", args)
+    for args in re.findall(r"^\s*conflict\s+([^\n(]+)$", text, re.M):
+        names += args.split()
+    return names
+
+
+def build(packages):
+    entries = {}
+    for package in packages:
+        name = package.get("package")
+        versions = package.get("versions") or []
+        if not name or not versions:
+            continue
+        default = None
+        for version in versions:
+            full = version.get("full") or "%s/%s" % (name, version.get("versionName", ""))
+            entries[full] = ("", ",".join(conflicts(version.get("path", ""))))
+            if version.get("markedDefault") or (
+                    package.get("defaultVersionName") and
+                    version.get("versionName") == package["defaultVersionName"]):
+                default = full
+        if not default:
+            # no marked default, lmod loads the highest version
+            default = max((v.get("full") or "%s/%s" % (name, v.get("versionName", "")) for v in versions),
+                          key=lambda full: version_key(full[len(name) + 1:]))
+        if name not in entries:
+            entries[name] = (default, "")
+    return entries
+
+
+def write(entries, output):
+    lines = ["%s\t%s\t%s\n" % (key, default, conflict)
+             for key, (default, conflict) in entries.items()
+             if not any(c in key for c in "\t\n, ")]
+    lines.sort(key=lambda line: line.split("\t", 1)[0].encode())
+    if output == "-":
+        sys.stdout.write(HEADER + "".join(lines))
+        return
+    fd, tmp = tempfile.mkstemp(dir=os.path.dirname(os.path.abspath(output)))
+    with os.fdopen(fd, "w") as f:
+        f.write(HEADER + "".join(lines))
+    os.chmod(tmp, 0o644)
+    os.rename(tmp, output)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="build the spank_lmod module index")
+    parser.add_argument("-j", "--json", help="read the \"spider -o jsonSoftwarePage\" output from this file (- for stdin)")
+    parser.add_argument("-o", "--output", default="-", help="the index file (default stdout)")
+    parser.add_argument("modulepath", nargs="*", help="module path directories (default $MODULEPATH)")
+    args = parser.parse_args()
+
+    if args.json:
+        with (sys.stdin if args.json == "-" else open(args.json)) as f:
+            packages = json.load(f)
+    else:
+        modulepath = args.modulepath or os.environ.get("MODULEPATH", "").split(":")
+        packages = spider([path for path in modulepath if path])
+    write(build(packages), args.output)
+
+
+if __name__ == "__main__":
+    main()
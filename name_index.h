@@ -0,0 +1,131 @@
+/******************************************************************************
+ *
+ *   name_index.h
+ *
+ *   Copyright (C) 2026 Hebrew University of Jerusalem Israel, see
+ *   LICENSE file.
+ *
+ *   Author: Yair Yarom <irush@cs.huji.ac.il>
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc., 59
+ *   Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ *****************************************************************************/
+
+/*
+  Small open addressing hash from a name to an int, for lookups built once (at
+  init() or on a configuration change) and probed many times.
+
+  Keys are not copied, they should point to memory that outlives the index
+  (e.g. the configuration strings). Lookups take an explicit length so
+  elements of comma separated lists can be probed without copying them.
+
+  Everything is static, each plugin including this gets its own copy.
+*/
+
+#ifndef _NAME_INDEX_H
+#define _NAME_INDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "src/common/xmalloc.h"
+
+typedef struct name_index {
+    uint32_t size;      // number of slots, power of 2
+    uint32_t count;     // number of used slots
+    const char** keys;
+    uint32_t* lens;
+    int* values;
+} name_index_t;
+
+/* FNV-1a */
+static inline uint32_t name_index_hash(const char* key, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static inline void name_index_init(name_index_t* idx, uint32_t expected) {
+    uint32_t size = 8;
+    while (size < expected * 2)
+        size <<= 1;
+    idx->size = size;
+    idx->count = 0;
+    idx->keys = xmalloc(size * sizeof(char*));
+    idx->lens = xmalloc(size * sizeof(uint32_t));
+    idx->values = xmalloc(size * sizeof(int));
+}
+
+static inline void name_index_free(name_index_t* idx) {
+    xfree(idx->keys);
+    xfree(idx->lens);
+    xfree(idx->values);
+    idx->size = 0;
+    idx->count = 0;
+}
+
+/* returns the slot of key, or of the empty slot it should go to */
+static inline uint32_t _name_index_slot(const name_index_t* idx, const char* key, size_t len) {
+    uint32_t mask = idx->size - 1;
+    uint32_t slot = name_index_hash(key, len) & mask;
+    while (idx->keys[slot]) {
+        if (idx->lens[slot] == len && memcmp(idx->keys[slot], key, len) == 0)
+            break;
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/* returns the value of key, or -1 if not found */
+static inline int name_index_get(const name_index_t* idx, const char* key, size_t len) {
+    if (idx->size == 0)
+        return -1;
+    uint32_t slot = _name_index_slot(idx, key, len);
+    return idx->keys[slot] ? idx->values[slot] : -1;
+}
+
+/* returns false if the key already exists (value not updated) */
+static inline bool name_index_add(name_index_t* idx, const char* key, size_t len, int value) {
+    if ((idx->count + 1) * 2 > idx->size) {
+        name_index_t bigger;
+        name_index_init(&bigger, idx->size);
+        for (uint32_t i = 0; i < idx->size; i++) {
+            if (idx->keys[i]) {
+                uint32_t slot = _name_index_slot(&bigger, idx->keys[i], idx->lens[i]);
+                bigger.keys[slot] = idx->keys[i];
+                bigger.lens[slot] = idx->lens[i];
+                bigger.values[slot] = idx->values[i];
+                bigger.count++;
+            }
+        }
+        name_index_free(idx);
+        *idx = bigger;
+    }
+
+    uint32_t slot = _name_index_slot(idx, key, len);
+    if (idx->keys[slot])
+        return false;
+    idx->keys[slot] = key;
+    idx->lens[slot] = len;
+    idx->values[slot] = value;
+    idx->count++;
+    return true;
+}
+
+#endif
@@ -0,0 +1,260 @@
+/******************************************************************************
+ *
+ *   partition_set.h
+ *
+ *   Copyright (C) 2026 Hebrew University of Jerusalem Israel, see
+ *   LICENSE file.
+ *
+ *   Author: Yair Yarom <irush@cs.huji.ac.il>
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc., 59
+ *   Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ *****************************************************************************/
+
+/*
+  Partition registry and partition sets, shared by the plugins which rewrite
+  job_desc->partition.
+
+  The registry interns the partitions of part_list into dense ids (in
+  part_list order), and is rebuilt whenever last_part_update changes. A
+  partition set is a bitmap over these ids, so union/intersection/difference
+  are word wide bit operations, and serializing a set back to a comma
+  separated string uses the cached names (and lengths) of the registry.
+
+  Sets are only valid for the registry generation they were created with. A
+  plugin keeping sets (e.g. from its configuration) should check
+  part_registry_sync() and rebuild them when it returns true.
+
+  part_registry_sync() reads part_list, so the partition read lock should be
+  held (which it is in job_submit() and job_modify()).
+*/
+
+#ifndef _PARTITION_SET_H
+#define _PARTITION_SET_H
+
+#include <slurm/slurm.h>
+
+#include "src/slurmctld/slurmctld.h"
+#include "src/common/bitstring.h"
+#include "src/common/xstring.h"
+
+#include "name_index.h"
+
+#if SLURM_VERSION_NUMBER < SLURM_VERSION_NUM(20,2,0)
+typedef struct part_record part_set_part_t;
+#else
+typedef part_record_t part_set_part_t;
+#endif
+
+typedef struct part_registry {
+    time_t last_update;     // last_part_update when built
+    uint32_t generation;    // increased on every rebuild
+    int count;
+    char** names;
+    size_t* name_lens;
+    part_set_part_t** parts;
+    name_index_t index;
+} part_registry_t;
+
+static part_registry_t part_registry = { 0 };
+
+static inline void part_registry_fini(void) {
+    for (int i = 0; i < part_registry.count; i++)
+        xfree(part_registry.names[i]);
+    xfree(part_registry.names);
+    xfree(part_registry.name_lens);
+    xfree(part_registry.parts);
+    name_index_free(&part_registry.index);
+    part_registry.count = 0;
+    part_registry.last_update = 0;
+}
+
+/*
+  rebuild the registry if part_list changed
+  returns true if rebuilt (i.e. existing sets should be rebuilt as well)
+*/
+static inline bool part_registry_sync(void) {
+    if (part_registry.names && part_registry.last_update == last_part_update)
+        return false;
+
+    part_registry_fini();
+
+    int count = part_list ? list_count(part_list) : 0;
+    part_registry.names = xmalloc((count + 1) * sizeof(char*));
+    part_registry.name_lens = xmalloc((count + 1) * sizeof(size_t));
+    part_registry.parts = xmalloc((count + 1) * sizeof(part_set_part_t*));
+    name_index_init(&part_registry.index, count);
+
+    if (part_list) {
+        part_set_part_t* part_ptr;
+        ListIterator it = list_iterator_create(part_list);
+        while ((part_ptr = (part_set_part_t*) list_next(it))) {
+            int id = part_registry.count;
+            if (id >= count)
+                break;
+            part_registry.names[id] = xstrdup(part_ptr->name);
+            part_registry.name_lens[id] = strlen(part_ptr->name);
+            part_registry.parts[id] = part_ptr;
+            if (name_index_add(&part_registry.index, part_registry.names[id], part_registry.name_lens[id], id))
+                part_registry.count++;
+            else
+                xfree(part_registry.names[id]);
+        }
+        list_iterator_destroy(it);
+    }
+
+    part_registry.last_update = last_part_update;
+    part_registry.generation++;
+    debug("partition_set: registry rebuilt with %i partitions (generation %u)", part_registry.count, part_registry.generation);
+    return true;
+}
+
+/* returns the id of the partition, or -1 if unknown */
+static inline int part_registry_id(const char* name, size_t len) {
+    return name_index_get(&part_registry.index, name, len);
+}
+
+static inline bitstr_t* part_set_alloc(void) {
+    // bit_alloc(0) isn't allowed, the extra bit is never set
+    return bit_alloc(part_registry.count ? part_registry.count : 1);
+}
+
+static inline void part_set_free(bitstr_t** set) {
+    FREE_NULL_BITMAP(*set);
+}
+
+static inline void part_set_fill(bitstr_t* set) {
+    if (part_registry.count)
+        bit_nset(set, 0, part_registry.count - 1);
+}
+
+static inline void part_set_union(bitstr_t* set, bitstr_t* other) {
+    bit_or(set, other);
+}
+
+static inline void part_set_intersect(bitstr_t* set, bitstr_t* other) {
+    bit_and(set, other);
+}
+
+static inline void part_set_subtract(bitstr_t* set, bitstr_t* other) {
+    bit_and_not(set, other);
+}
+
+/*
+  adds the partitions of the comma separated "str" to set
+  returns the number of unknown partitions (which are ignored), the first one
+  is returned in *unknown (pointing into str, with its length in *unknown_len)
+  if given
+*/
+static inline int part_set_add_str(bitstr_t* set, const char* str, const char** unknown, size_t* unknown_len) {
+    int n_unknown = 0;
+    if (!str)
+        return 0;
+
+    const char* p = str;
+    while (*p) {
+        const char* end = p;
+        while (*end && *end != ',')
+            end++;
+        if (end > p) {
+            int id = part_registry_id(p, end - p);
+            if (id >= 0) {
+                bit_set(set, id);
+            } else {
+                if (n_unknown == 0 && unknown) {
+                    *unknown = p;
+                    *unknown_len = end - p;
+                }
+                n_unknown++;
+            }
+        }
+        if (!*end)
+            break;
+        p = end + 1;
+    }
+    return n_unknown;
+}
+
+/* returns the comma separated partitions of set (in part_list order), NULL if empty */
+static inline char* part_set_to_str(bitstr_t* set) {
+    size_t len = 0;
+    for (int i = 0; i < part_registry.count; i++) {
+        if (bit_test(set, i))
+            len += part_registry.name_lens[i] + 1;
+    }
+    if (len == 0)
+        return NULL;
+
+    char* str = xmalloc(len);
+    char* p = str;
+    for (int i = 0; i < part_registry.count; i++) {
+        if (bit_test(set, i)) {
+            if (p != str)
+                *p++ = ',';
+            memcpy(p, part_registry.names[i], part_registry.name_lens[i]);
+            p += part_registry.name_lens[i];
+        }
+    }
+    *p = 0;
+    return str;
+}
+
+/*
+  returns the comma separated "str" with only existing partitions and without
+  duplicates, keeping the configured order. NULL if none exists. Unknown
+  partitions are logged with "plugin" as prefix.
+*/
+static inline char* part_set_normalize(const char* str, const char* plugin) {
+    const char* unknown = NULL;
+    size_t unknown_len = 0;
+    int n_unknown = 0;
+    char* res = NULL;
+    if (!str)
+        return NULL;
+
+    bitstr_t* seen = part_set_alloc();
+    const char* p = str;
+    while (*p) {
+        const char* end = p;
+        while (*end && *end != ',')
+            end++;
+        if (end > p) {
+            int id = part_registry_id(p, end - p);
+            if (id < 0) {
+                if (n_unknown == 0) {
+                    unknown = p;
+                    unknown_len = end - p;
+                }
+                n_unknown++;
+            } else if (!bit_test(seen, id)) {
+                bit_set(seen, id);
+                if (res)
+                    xstrcat(res, ",");
+                xstrncat(res, p, end - p);
+            }
+        }
+        if (!*end)
+            break;
+        p = end + 1;
+    }
+    part_set_free(&seen);
+
+    if (n_unknown) {
+        error("%s: %i unknown partition(s) in \"%s\" (e.g. %.*s)", plugin, n_unknown, str, (int)unknown_len, unknown);
+    }
+    return res;
+}
+
+#endif
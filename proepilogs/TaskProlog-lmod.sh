@@ -1,5 +1,10 @@
 #!/bin/bash
 
+# already done once for the whole step by spank_lmod
+if [[ -n "$SPANK_LMOD_APPLIED" ]]; then
+    exit 0
+fi
+
 declare -A origenv
 
 for var in $(compgen -e); do
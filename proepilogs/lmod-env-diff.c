@@ -0,0 +1,206 @@
+/******************************************************************************
+ *
+ *   lmod-env-diff.c
+ *
+ *   Copyright (C) 2026 Hebrew University of Jerusalem Israel, see
+ *   LICENSE file.
+ *
+ *   Author: Yair Yarom <irush@cs.huji.ac.il>
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc., 59
+ *   Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ *****************************************************************************/
+
+/*
+  A compiled replacement of TaskProlog-lmod.sh, usable as a TaskProlog and as
+  the spank_lmod script.
+
+  The current environment is the "before" snapshot. A single bash runs module
+  reset, the lmodrc files (unless "purge" is given) and one module try-load of
+  all the SPANK_MODULES modules, and then writes its environment (env -0) to
+  fd 3, which is the "after" snapshot. Both are sorted by name and merged, and
+  the differences are printed as "export name=value" and "unset name" lines.
+
+  Variables bash itself sets or changes (SHLVL, _, PWD, OLDPWD), exported
+  functions and values with newlines (which can't be passed in these lines)
+  are left out.
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static const char *script =
+    "mode=$1; shift\n"
+    "module reset >/dev/null 2>&1\n"
+    "if [ \"$mode\" != purge ]; then\n"
+    "    [ -e /etc/lmod/lmodrc ] && . /etc/lmod/lmodrc\n"
+    "    [ -e ~/.lmodrc ] && . ~/.lmodrc\n"
+    "fi\n"
+    "[ $# -gt 0 ] && module try-load \"$@\" >/dev/null 2>&1\n"
+    "exec env -0 >&3\n";
+
+typedef struct env {
+    char **vars;
+    size_t count;
+} env_t;
+
+static int _name_cmp(const char *a, const char *b) {
+    for (; *a == *b && *a != '=' && *a; a++, b++)
+        ;
+    // '=' ends the name, so it sorts first
+    return (*a == '=' ? 0 : (unsigned char)*a) - (*b == '=' ? 0 : (unsigned char)*b);
+}
+
+static int _var_cmp(const void *a, const void *b) {
+    return _name_cmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int _ignored(const char *var) {
+    const char *value = strchr(var, '=');
+    if (!value)
+        return 1;
+    return strncmp(var, "SHLVL=", 6) == 0 || strncmp(var, "_=", 2) == 0 ||
+           strncmp(var, "PWD=", 4) == 0 || strncmp(var, "OLDPWD=", 7) == 0 ||
+           strncmp(var, "BASH_FUNC_", 10) == 0 || strchr(value, '\n');
+}
+
+static void _env_add(env_t *env, char *var) {
+    if (_ignored(var))
+        return;
+    if ((env->count & (env->count + 1)) == 0)
+        env->vars = realloc(env->vars, (env->count + 1) * 2 * sizeof(char*));
+    env->vars[env->count++] = var;
+}
+
+/* runs the modules in bash, and returns its environment (NUL separated) */
+static char *_run(const char *mode, const char *modules, size_t *len) {
+    posix_spawn_file_actions_t actions;
+    char **argv, *list = strdup(modules ? modules : ""), *data = NULL;
+    size_t argc = 4, size = 0;
+    int pfd[2], status, rc;
+    pid_t pid;
+
+    argv = malloc((strlen(list) + 6) * sizeof(char*));
+    argv[0] = "bash";
+    argv[1] = "-c";
+    argv[2] = (char *)script;
+    argv[3] = "lmod-env-diff";
+    argv[argc++] = (char *)mode;
+    for (char *module = strtok(list, ", \t"); module; module = strtok(NULL, ", \t"))
+        argv[argc++] = module;
+    argv[argc] = NULL;
+
+    if (pipe2(pfd, O_CLOEXEC) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pfd[1], 3);
+    // module output isn't part of the diff
+    posix_spawn_file_actions_adddup2(&actions, 2, 1);
+    rc = posix_spawnp(&pid, "bash", &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(pfd[1]);
+    free(argv);
+    if (rc) {
+        errno = rc;
+        perror("bash");
+        exit(1);
+    }
+
+    *len = 0;
+    while (1) {
+        ssize_t n;
+        if (size - *len < 65536) {
+            size = size ? size * 2 : 262144;
+            data = realloc(data, size);
+        }
+        n = read(pfd[0], data + *len, size - *len - 1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        *len += n;
+    }
+    data[*len] = '\0';
+    close(pfd[0]);
+    free(list);
+
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || *len == 0) {
+        fprintf(stderr, "lmod-env-diff: bash failed\n");
+        exit(1);
+    }
+    return data;
+}
+
+int main(int argc, char **argv) {
+    const char *mode = (argc > 1 && strcmp(argv[1], "purge") == 0) ? "purge" : "load";
+    env_t before = { NULL, 0 }, after = { NULL, 0 };
+    size_t i = 0, j = 0, len;
+    char *data;
+
+    // already done once for the whole step by spank_lmod
+    if (getenv("SPANK_LMOD_APPLIED"))
+        return 0;
+
+    for (char **var = environ; *var; var++)
+        _env_add(&before, *var);
+    data = _run(mode, getenv("SPANK_MODULES"), &len);
+    for (char *var = data; var < data + len; var += strlen(var) + 1)
+        _env_add(&after, var);
+
+    qsort(before.vars, before.count, sizeof(char*), _var_cmp);
+    qsort(after.vars, after.count, sizeof(char*), _var_cmp);
+
+    while (i < before.count || j < after.count) {
+        int cmp = (i == before.count) ? 1 : (j == after.count) ? -1 :
+                  _name_cmp(before.vars[i], after.vars[j]);
+        if (cmp < 0) {
+            printf("unset %.*s\n", (int)strcspn(before.vars[i], "="), before.vars[i]);
+            i++;
+        } else if (cmp > 0) {
+            const char *value = strchr(after.vars[j], '=') + 1;
+            if (*value)
+                printf("export %s\n", after.vars[j]);
+            j++;
+        } else {
+            const char *value = strchr(after.vars[j], '=') + 1;
+            if (strcmp(strchr(before.vars[i], '=') + 1, value)) {
+                if (*value)
+                    printf("export %s\n", after.vars[j]);
+                else
+                    printf("unset %.*s\n", (int)strcspn(after.vars[j], "="), after.vars[j]);
+            }
+            i++;
+            j++;
+        }
+    }
+
+    free(before.vars);
+    free(after.vars);
+    free(data);
+    return 0;
+}
@@ -0,0 +1,381 @@
+/******************************************************************************
+ *
+ *   spank_idle.c
+ *
+ *   Copyright (C) 2026 Hebrew University of Jerusalem Israel, see LICENSE
+ *   file.
+ *
+ *   Author: Yair Yarom <irush@cs.huji.ac.il>
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc., 59
+ *   Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ *****************************************************************************/
+
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <slurm/slurm.h>
+#include <slurm/spank.h>
+
+SPANK_PLUGIN(idle, 1);
+
+#define MAX_PARTITIONS 32
+
+/* per partition policy, idle = 0 disables */
+typedef struct idle_policy {
+    char partition[64];
+    unsigned int idle;
+    unsigned int warn;
+} idle_policy_t;
+
+static unsigned int interval = 60;
+static double cpu_threshold = 1.0;  // percent of a single cpu
+static char cgroup_root[PATH_MAX] = "/sys/fs/cgroup";
+static bool multinode = false;
+static idle_policy_t default_policy = { "", 0, 600 };
+static idle_policy_t policies[MAX_PARTITIONS];
+static int policy_count = 0;
+
+/* the monitor thread, one per job in the extern step of the first node */
+static pthread_t monitor_thread;
+static bool monitor_running = false;
+static bool monitor_stop = false;
+static pthread_mutex_t monitor_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t monitor_cond = PTHREAD_COND_INITIALIZER;
+
+static uint32_t job_id = 0;
+static uid_t job_uid = 0;
+static idle_policy_t job_policy;
+static char cpu_path[PATH_MAX] = "";
+static bool cpu_v2 = false;
+
+/*
+  arguments (in plugstack.conf):
+  interval=<seconds>        sampling interval (60)
+  idle=<seconds>            idle time before the job is cancelled (0, disabled)
+  warn=<seconds>            warn the user this long before cancelling (600)
+  cpu=<percent>             cpu usage (of a single cpu) below which the job is
+                            idle (1)
+  cgroup=<path>             cgroup mount point (/sys/fs/cgroup)
+  partition=<name>:<idle>[:<warn>]
+                            policy for a specific partition
+  multinode=yes|no          also monitor multi node jobs, by the activity of
+                            their first node only (no)
+*/
+static int _parse_args(int ac, char **av) {
+    for (int i = 0; i < ac; i++) {
+        char *end = NULL;
+        if (strncmp(av[i], "interval=", 9) == 0) {
+            interval = strtoul(av[i] + 9, &end, 10);
+        } else if (strncmp(av[i], "idle=", 5) == 0) {
+            default_policy.idle = strtoul(av[i] + 5, &end, 10);
+        } else if (strncmp(av[i], "warn=", 5) == 0) {
+            default_policy.warn = strtoul(av[i] + 5, &end, 10);
+        } else if (strncmp(av[i], "cpu=", 4) == 0) {
+            cpu_threshold = strtod(av[i] + 4, &end);
+        } else if (strncmp(av[i], "cgroup=", 7) == 0) {
+            snprintf(cgroup_root, sizeof(cgroup_root), "%s", av[i] + 7);
+            end = "";
+        } else if (strcmp(av[i], "multinode=yes") == 0 || strcmp(av[i], "multinode=no") == 0) {
+            multinode = av[i][10] == 'y';
+            end = "";
+        } else if (strncmp(av[i], "partition=", 10) == 0) {
+            if (policy_count == MAX_PARTITIONS) {
+                slurm_error("spank_idle: too many partitions");
+                return -1;
+            }
+            idle_policy_t *policy = &policies[policy_count];
+            char *colon = strchr(av[i] + 10, ':');
+            if (!colon || colon - (av[i] + 10) >= (int)sizeof(policy->partition)) {
+                slurm_error("spank_idle: bad argument %s", av[i]);
+                return -1;
+            }
+            snprintf(policy->partition, colon - (av[i] + 10) + 1, "%s", av[i] + 10);
+            policy->idle = strtoul(colon + 1, &end, 10);
+            policy->warn = default_policy.warn;
+            if (*end == ':')
+                policy->warn = strtoul(end + 1, &end, 10);
+            policy_count++;
+        }
+        if (!end || *end) {
+            slurm_error("spank_idle: bad argument %s", av[i]);
+            return -1;
+        }
+    }
+    if (interval < 1)
+        interval = 1;
+    return 0;
+}
+
+/* the policy of the (first) partition of the job */
+static idle_policy_t *_policy(const char *partition) {
+    for (int i = 0; i < policy_count; i++) {
+        size_t len = strlen(policies[i].partition);
+        if (strncmp(partition, policies[i].partition, len) == 0 &&
+            (partition[len] == '\0' || partition[len] == ','))
+            return &policies[i];
+    }
+    return &default_policy;
+}
+
+/* finds the cpu usage file of the job cgroup (v2, then v1) */
+static bool _find_cpu_path(void) {
+    struct stat st;
+
+    snprintf(cpu_path, sizeof(cpu_path), "%s/system.slice/slurmstepd.scope/job_%u/cpu.stat", cgroup_root, job_id);
+    if (stat(cpu_path, &st) == 0) {
+        cpu_v2 = true;
+        return true;
+    }
+
+    snprintf(cpu_path, sizeof(cpu_path), "%s/cpuacct/slurm/uid_%u/job_%u/cpuacct.usage", cgroup_root, job_uid, job_id);
+    if (stat(cpu_path, &st) == 0) {
+        cpu_v2 = false;
+        return true;
+    }
+
+    cpu_path[0] = 0;
+    return false;
+}
+
+/* cpu usage of the job in usec, or -1 on error */
+static int64_t _cpu_usage(void) {
+    char buf[256];
+    int64_t usage = -1;
+    FILE *f = fopen(cpu_path, "r");
+    if (!f)
+        return -1;
+    if (cpu_v2) {
+        // "usage_usec <n>" is the first line of cpu.stat
+        while (fgets(buf, sizeof(buf), f)) {
+            if (sscanf(buf, "usage_usec %" SCNd64, &usage) == 1)
+                break;
+        }
+    } else if (fgets(buf, sizeof(buf), f)) {
+        // nanoseconds
+        if (sscanf(buf, "%" SCNd64, &usage) == 1)
+            usage /= 1000;
+    }
+    fclose(f);
+    return usage;
+}
+
+/*
+  adds the last activity on the terminals (stdin) of the processes in the
+  cgroup dir and its sub cgroups (the steps and tasks) to *last
+*/
+static void _tty_activity_dir(const char *dir, int depth, time_t *last) {
+    char path[PATH_MAX];
+    char tty[PATH_MAX];
+    struct stat st;
+    FILE *f;
+    DIR *d;
+    struct dirent *de;
+    int pid;
+
+    snprintf(path, sizeof(path), "%s/cgroup.procs", dir);
+    if ((f = fopen(path, "r"))) {
+        while (fscanf(f, "%d", &pid) == 1) {
+            snprintf(path, sizeof(path), "/proc/%d/fd/0", pid);
+            ssize_t len = readlink(path, tty, sizeof(tty) - 1);
+            if (len <= 0)
+                continue;
+            tty[len] = 0;
+            if (strncmp(tty, "/dev/pts/", 9) != 0 && strncmp(tty, "/dev/tty", 8) != 0)
+                continue;
+            if (stat(tty, &st) != 0)
+                continue;
+            if (st.st_atime > *last)
+                *last = st.st_atime;
+            if (st.st_mtime > *last)
+                *last = st.st_mtime;
+        }
+        fclose(f);
+    }
+
+    if (depth == 0 || !(d = opendir(dir)))
+        return;
+    while ((de = readdir(d))) {
+        if (de->d_name[0] == '.' || de->d_type != DT_DIR)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        _tty_activity_dir(path, depth - 1, last);
+    }
+    closedir(d);
+}
+
+/* last activity on the terminals of the job's processes, 0 if none */
+static time_t _tty_activity(void) {
+    char dir[PATH_MAX];
+    time_t last = 0;
+    snprintf(dir, sizeof(dir), "%s", cpu_path);
+    char *slash = strrchr(dir, '/');
+    if (!slash)
+        return 0;
+    *slash = 0;
+    _tty_activity_dir(dir, 4, &last);
+    return last;
+}
+
+/*
+  loads the job from slurmctld, and sets its policy. false if the job isn't
+  monitored: not interactive (see job_submit_limit_interactive), disabled for
+  its partition, or on several nodes (unless multinode=yes)
+*/
+static bool _load_job(void) {
+    job_info_msg_t *msg = NULL;
+    bool monitored = false;
+
+    if (slurm_load_job(&msg, job_id, SHOW_ALL) != SLURM_SUCCESS || !msg || msg->record_count < 1) {
+        slurm_error("spank_idle: can't load job %u", job_id);
+        if (msg)
+            slurm_free_job_info_msg(msg);
+        return false;
+    }
+    job_info_t *job = &msg->job_array[0];
+    job_policy = *_policy(job->partition ? job->partition : "");
+    if (!job->licenses || !strstr(job->licenses, "interactive"))
+        slurm_debug("spank_idle: job %u isn't interactive", job_id);
+    else if (job_policy.idle == 0)
+        slurm_debug("spank_idle: job %u: disabled for partition %s", job_id, job->partition);
+    else if (job->num_nodes > 1 && !multinode)
+        slurm_debug("spank_idle: job %u is on %u nodes, not monitored", job_id, job->num_nodes);
+    else
+        monitored = true;
+    slurm_free_job_info_msg(msg);
+    return monitored;
+}
+
+static void *_monitor(void *arg) {
+    if (!_load_job())
+        return NULL;
+    if (!_find_cpu_path()) {
+        slurm_error("spank_idle: can't find cgroup of job %u", job_id);
+        return NULL;
+    }
+    slurm_debug("spank_idle: monitoring job %u (idle=%u warn=%u)", job_id, job_policy.idle, job_policy.warn);
+
+    int64_t last_cpu = _cpu_usage();
+    time_t last_tty = _tty_activity();
+    unsigned int idle_time = 0;
+    bool warned = false;
+    int64_t threshold = (int64_t)(cpu_threshold / 100.0 * interval * 1000000);
+
+    pthread_mutex_lock(&monitor_lock);
+    while (!monitor_stop) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += interval;
+        if (pthread_cond_timedwait(&monitor_cond, &monitor_lock, &ts) != ETIMEDOUT)
+            continue;
+
+        int64_t cpu = _cpu_usage();
+        time_t tty = _tty_activity();
+        bool idle = (cpu >= 0 && last_cpu >= 0 && cpu - last_cpu < threshold) && tty == last_tty;
+        last_cpu = cpu;
+        last_tty = tty;
+
+        if (!idle) {
+            idle_time = 0;
+            warned = false;
+            continue;
+        }
+        idle_time += interval;
+        slurm_debug("spank_idle: job %u idle for %us", job_id, idle_time);
+
+        if (idle_time >= job_policy.idle) {
+            slurm_info("spank_idle: job %u idle for %us, cancelling", job_id, idle_time);
+            slurm_kill_job(job_id, SIGKILL, 0);
+            break;
+        }
+        if (!warned && job_policy.warn && idle_time + job_policy.warn >= job_policy.idle) {
+            char msg[256];
+            snprintf(msg, sizeof(msg), "job %u has been idle for %u minutes and will be cancelled in %u minutes",
+                     job_id, idle_time / 60, (job_policy.idle - idle_time) / 60);
+            slurm_notify_job(job_id, msg);
+            warned = true;
+        }
+    }
+    pthread_mutex_unlock(&monitor_lock);
+    return NULL;
+}
+
+int slurm_spank_init(spank_t spank, int ac, char **av) {
+    if (!spank_remote(spank))
+        return ESPANK_SUCCESS;
+    if (_parse_args(ac, av))
+        return ESPANK_BAD_ARG;
+    return ESPANK_SUCCESS;
+}
+
+/*
+  starts the monitor from the extern step (PrologFlags=Contain) of the first
+  node. It's the only step of a bare salloc, and there's one per job, however
+  many steps run. The rest is checked in the monitor thread, so the step
+  launch doesn't wait for slurmctld
+*/
+int slurm_spank_task_post_fork(spank_t spank, int ac, char **av) {
+    uint32_t nodeid, stepid;
+
+    if (monitor_running)
+        return ESPANK_SUCCESS;
+    if (spank_get_item(spank, S_JOB_NODEID, &nodeid) != ESPANK_SUCCESS || nodeid != 0)
+        return ESPANK_SUCCESS;
+    if (spank_get_item(spank, S_JOB_STEPID, &stepid) != ESPANK_SUCCESS || stepid != SLURM_EXTERN_CONT)
+        return ESPANK_SUCCESS;
+    if (default_policy.idle == 0) {
+        bool enabled = false;
+        for (int i = 0; i < policy_count; i++)
+            enabled |= policies[i].idle > 0;
+        if (!enabled)
+            return ESPANK_SUCCESS;
+    }
+
+    spank_get_item(spank, S_JOB_ID, &job_id);
+    spank_get_item(spank, S_JOB_UID, &job_uid);
+
+    monitor_stop = false;
+    if (pthread_create(&monitor_thread, NULL, _monitor, NULL) != 0) {
+        slurm_error("spank_idle: can't create monitor thread: %m");
+        return ESPANK_SUCCESS;
+    }
+    monitor_running = true;
+
+    return ESPANK_SUCCESS;
+}
+
+int slurm_spank_exit(spank_t spank, int ac, char **av) {
+    if (!monitor_running)
+        return ESPANK_SUCCESS;
+
+    pthread_mutex_lock(&monitor_lock);
+    monitor_stop = true;
+    pthread_cond_signal(&monitor_cond);
+    pthread_mutex_unlock(&monitor_lock);
+    pthread_join(monitor_thread, NULL);
+    monitor_running = false;
+
+    return ESPANK_SUCCESS;
+}
@@ -23,6 +23,8 @@
  *
  *****************************************************************************/
 
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include <slurm/spank.h>
@@ -31,21 +33,32 @@ SPANK_PLUGIN(killable, 1);
 
 static int _opt_process (int val, const char *optarg, int remote);
 static int is_killable = 0;
+static unsigned long killable_tier = 0;
 
 struct spank_option spank_option_array[] = {
-    { "killable", NULL, "run a killable job", 0, 0, (spank_opt_cb_f)_opt_process },
+    { "killable", "tier", "run a killable job (of the optional tier)", 2, 0, (spank_opt_cb_f)_opt_process },
     SPANK_OPTIONS_TABLE_END
 };
 
 static int _opt_process(int val, const char *optarg, int remote) {
+    char *end;
     //slurm_info("spank_killable: setting killable");
     is_killable = 1;
+    killable_tier = 0;
+    if (optarg && *optarg) {
+        killable_tier = strtoul(optarg, &end, 10);
+        if (*end || killable_tier > UINT32_MAX) {
+            slurm_error("spank_killable: invalid tier %s", optarg);
+            return -1;
+        }
+    }
     return 0;
 }
 
 int slurm_spank_init(spank_t spank, int ac, char **av) {
     int i, j, rc = ESPANK_SUCCESS;
     is_killable = 0;
+    killable_tier = 0;
     //slurm_info("spank_killable: init");
 
     for (i = 0; spank_option_array[i].name; i++) {
@@ -59,7 +72,28 @@ int slurm_spank_init(spank_t spank, int ac, char **av) {
     return rc;
 }
 
+/*
+  Sets KILLABLE=<version>:<tier> in the job control environment (SPANK_KILLABLE
+  in the prolog/epilog), which job_submit_killable finds by prefix instead of
+  by the option's internal name. The version is 1, 0 (or no variable) means not killable.
+  SPANK_KILLABLE is also set in the process environment (0 if not killable),
+  so it's inherited by the job.
+*/
 int slurm_spank_init_post_opt(spank_t spank, int ac, char **av) {
-    // doesn't really work..
-    return setenv("SPANK_KILLABLE", is_killable ? "1" : "0", 1);
+    char value[32];
+    spank_context_t context = spank_context();
+
+    if (context != S_CTX_LOCAL && context != S_CTX_ALLOCATOR)
+        return ESPANK_SUCCESS;
+
+    snprintf(value, sizeof(value), "1:%lu", killable_tier);
+    setenv("SPANK_KILLABLE", is_killable ? value : "0", 1);
+    if (!is_killable)
+        return ESPANK_SUCCESS;
+
+    if (spank_job_control_setenv(spank, "KILLABLE", value, 1) != ESPANK_SUCCESS) {
+        slurm_error("spank_killable: can't set the job control environment");
+        return -1;
+    }
+    return ESPANK_SUCCESS;
 }
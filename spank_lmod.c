@@ -32,15 +32,25 @@
  *
  *****************************************************************************/
 
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <poll.h>
 #include <signal.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <time.h>
 
 #include <slurm/spank.h>
 
@@ -54,13 +64,112 @@ struct spank_option spank_option_array[] = {
     SPANK_OPTIONS_TABLE_END
 };
 
+extern char **environ;
+
+/*
+  The environment diff computed in local/allocator context is cached, in
+  cache_dir/<key>, where the key is a hash of the uid, the script and the
+  environment (without the cache_ignore variables). Each entry also has the
+  stamps (hash of the mtime, and for directories of the mtimes of their
+  entries) of the script, the lmodrc files, the module path directories and the
+  cache_stamp paths, which are checked before using it:
+
+  spank_lmod cache 1
+  stamp <hash> <path>
+  ...
+  --
+  <script output>
+
+  Entries which don't match their stamps are removed, and entries older than
+  cache_age are removed whenever a new one is written.
+*/
+#define CACHE_HEADER "spank_lmod cache 1\n"
+#define CACHE_MAX_SIZE (4 * 1024 * 1024)
+
+static char cache_dir[PATH_MAX] = "";
+static int cache_disabled = 0;
+static unsigned int cache_age = 7 * 24 * 3600;
+static char *cache_stamps = NULL;
+static char *cache_ignore = NULL;
+
+/*
+  In remote context the script is run once per step (on each node) in
+  slurm_spank_user_init(), and the result is set in the job environment with
+  LMOD_MARKER, so TaskProlog-lmod.sh doesn't run it again for each task.
+*/
+#define LMOD_MARKER "SPANK_LMOD_APPLIED"
+static int remote_env = 1;
+
+/*
+  The PATH-like variables (compact) the script sets are compacted when
+  applied: duplicate entries are removed (keeping the first) and, on the
+  compute nodes with prune=yes, so are directories which don't exist there.
+  The drop variables are removed from the environment.
+*/
+static char *compact_vars = NULL;
+static char *drop_vars = NULL;
+static int prune_dirs = 0;
+
+/* script run time limit, in seconds (0 for none) */
+static unsigned int timeout = 60;
+/* the _run_script() result of a script killed after the timeout */
+#define SCRIPT_TIMEOUT -2
+
+typedef struct buf {
+    char *data;
+    size_t len;
+    size_t size;
+} buf_t;
+
+/* a variable the script output sets or unsets, offsets in the output */
+typedef struct env_change {
+    size_t name;
+    size_t name_len;
+    size_t value;
+    size_t value_len;
+    int unset;
+} env_change_t;
+
+/*
+  the script output, parsed as it's read: the complete lines up to parsed are
+  in changes. Nothing is copied, the strings are terminated in place when
+  applied
+*/
+typedef struct script_output {
+    buf_t buf;
+    size_t parsed;
+    env_change_t *changes;
+    size_t count;
+    size_t size;
+} script_output_t;
+
+/*
+  The module index (index=<path>, built by lmod-module-index.py) is used to
+  check --module on the submission side. It's a header line followed by lines
+  sorted by their (byte order) key:
+
+  <name>\t<default full name>\t
+  <full name>\t\t<conflicting modules, comma separated>
+
+  The file is mmap()ed, and the modules are looked up with a binary search.
+*/
+#define INDEX_HEADER "# spank_lmod module index 1\n"
+
+static char *index_path = NULL;
+
+static int _parse_args(int ac, char **av);
+static int _check_modules(const char *list);
 static int _run_script_and_set_env(const char *path);
+static int _run_script_and_set_job_env(spank_t spank, const char *path);
 
 int slurm_spank_init(spank_t spank, int ac, char **av) {
     int i, j, rc = ESPANK_SUCCESS;
     modules = 0;
     //slurm_info("spank_lmod: init");
 
+    if (ac && _parse_args(ac - 1, av + 1))
+        return ESPANK_BAD_ARG;
+
     for (i = 0; spank_option_array[i].name; i++) {
         j = spank_option_register(spank, &spank_option_array[i]);
         if (j != ESPANK_SUCCESS) {
@@ -88,6 +197,8 @@ int slurm_spank_init_post_opt(spank_t spank, int ac, char **av) {
       case S_CTX_ALLOCATOR:
           //slurm_info("spank_lmod: init post opt: local/allocator context");
           if (ac) {
+              // inherited from the job environment (e.g. srun in sbatch)
+              unsetenv(LMOD_MARKER);
               return _run_script_and_set_env(av[0]);
           }
           break;
@@ -99,149 +210,1115 @@ int slurm_spank_init_post_opt(spank_t spank, int ac, char **av) {
     return rc;
 }
 
+int slurm_spank_user_init(spank_t spank, int ac, char **av) {
+    if (spank_context() != S_CTX_REMOTE || !ac)
+        return ESPANK_SUCCESS;
+    if (!remote_env)
+        return ESPANK_SUCCESS;
+    return _run_script_and_set_job_env(spank, av[0]);
+}
+
 static int _opt_process(int val, const char *optarg, int remote) {
+    if (!remote && index_path && _check_modules(optarg))
+        return -1;
+    free(modules);
     modules = strdup(optarg);
     return 0;
 }
 
-static void _proc_stdout(char *buf) {
-    int end_buf = 0;
-    char *buf_ptr, *name_ptr, *val_ptr;
-    char *end_line, *equal_ptr;
-
-    buf_ptr = buf;
-    while (buf_ptr[0]) {
-        end_line = strchr(buf_ptr, '\n');
-        if (!end_line) {
-            end_line = buf_ptr + strlen(buf_ptr);
-            end_buf = 1;
-        }
-        if (!strncmp(buf_ptr, "export ",7)) {
-            name_ptr = buf_ptr + 7;
-            while (isspace(name_ptr[0]))
-                name_ptr++;
-            equal_ptr = strchr(name_ptr, '=');
-            if (!equal_ptr || (equal_ptr > end_line))
-                goto rwfail;
-            val_ptr = equal_ptr + 1;
-            while (isspace(equal_ptr[-1]))
-                equal_ptr--;
-            equal_ptr[0] = '\0';
-            end_line[0] = '\0';
-            slurm_debug("export name:%s:val:%s:", name_ptr, val_ptr);
-            if (setenv(name_ptr, val_ptr, 1)) {
-                slurm_error("Unable to set %s environment variable",
-                            buf_ptr);
-            }
-            equal_ptr[0] = '=';
-            if (end_buf)
-                end_line[0] = '\0';
-            else
-                end_line[0] = '\n';
-        } else if (!strncmp(buf_ptr, "unset ", 6)) {
-            name_ptr = buf_ptr + 6;
-            while (isspace(name_ptr[0]))
-                name_ptr++;
-            if ((name_ptr[0] == '\n') || (name_ptr[0] == '\0'))
-                goto rwfail;
-            while (isspace(end_line[-1]))
-                end_line--;
-            end_line[0] = '\0';
-            slurm_debug(" unset name:%s:", name_ptr);
-            unsetenv(name_ptr);
-            if (end_buf)
-                end_line[0] = '\0';
+/*
+  arguments (in plugstack.conf, after the script):
+  cache_dir=<dir>           directory of the cached environments
+                            ($XDG_CACHE_HOME/spank_lmod or ~/.cache/spank_lmod),
+                            "none" disables the cache
+  cache_age=<seconds>       entries older than this are removed (604800)
+  cache_stamp=<path>[:...]  more files or directories whose change invalidates
+                            the cache (e.g. the lmod spider cache)
+  cache_ignore=<var>[,...]  variables not part of the cache key, a trailing *
+                            matches a prefix (SLURM_*,SSH_*,XDG_SESSION_*,PWD,
+                            OLDPWD,SHLVL,_)
+  remote=<yes|no>           run the script once per step instead of in the
+                            TaskProlog of each task (yes)
+  timeout=<seconds>         the script is killed after this, and the
+                            environment isn't changed, 0 for none (60)
+  index=<path>              module index checking --module on submission
+  compact=<var>[,...]       PATH-like variables whose duplicate entries are
+                            removed (a trailing * matches a prefix)
+  prune=<yes|no>            also remove the directories of the compact
+                            variables that don't exist, on the compute nodes (no)
+  drop=<var>[,...]          variables removed from the environment (a trailing
+                            * matches a prefix)
+*/
+static int _parse_args(int ac, char **av) {
+    const char *base;
+
+    free(cache_stamps);
+    free(cache_ignore);
+    free(index_path);
+    free(compact_vars);
+    free(drop_vars);
+    index_path = NULL;
+    compact_vars = NULL;
+    drop_vars = NULL;
+    prune_dirs = 0;
+    cache_stamps = NULL;
+    cache_ignore = strdup("SLURM_*,SSH_*,XDG_SESSION_*,PWD,OLDPWD,SHLVL,_");
+    cache_dir[0] = '\0';
+    cache_disabled = 0;
+    remote_env = 1;
+
+    for (int i = 0; i < ac; i++) {
+        char *end = NULL;
+        if (strncmp(av[i], "cache_dir=", 10) == 0) {
+            if (strcmp(av[i] + 10, "none") == 0)
+                cache_disabled = 1;
             else
-                end_line[0] = '\n';
+                snprintf(cache_dir, sizeof(cache_dir), "%s", av[i] + 10);
+            end = "";
+        } else if (strncmp(av[i], "cache_age=", 10) == 0) {
+            cache_age = strtoul(av[i] + 10, &end, 10);
+        } else if (strncmp(av[i], "index=", 6) == 0) {
+            index_path = strdup(av[i] + 6);
+            end = "";
+        } else if (strncmp(av[i], "timeout=", 8) == 0) {
+            timeout = strtoul(av[i] + 8, &end, 10);
+        } else if (strncmp(av[i], "cache_stamp=", 12) == 0) {
+            free(cache_stamps);
+            cache_stamps = strdup(av[i] + 12);
+            end = "";
+        } else if (strncmp(av[i], "cache_ignore=", 13) == 0) {
+            free(cache_ignore);
+            cache_ignore = strdup(av[i] + 13);
+            end = "";
+        } else if (strncmp(av[i], "compact=", 8) == 0) {
+            free(compact_vars);
+            compact_vars = strdup(av[i] + 8);
+            end = "";
+        } else if (strncmp(av[i], "drop=", 5) == 0) {
+            free(drop_vars);
+            drop_vars = strdup(av[i] + 5);
+            end = "";
+        } else if (strcmp(av[i], "prune=yes") == 0) {
+            prune_dirs = 1;
+            end = "";
+        } else if (strcmp(av[i], "prune=no") == 0) {
+            prune_dirs = 0;
+            end = "";
+        } else if (strcmp(av[i], "remote=yes") == 0) {
+            remote_env = 1;
+            end = "";
+        } else if (strcmp(av[i], "remote=no") == 0) {
+            remote_env = 0;
+            end = "";
         }
+        if (!end || *end) {
+            slurm_error("spank_lmod: bad argument %s", av[i]);
+            return -1;
+        }
+    }
 
-    rwfail:		 /* process rest of script output */
-        if (end_buf)
+    if (!cache_dir[0] && !cache_disabled) {
+        if ((base = getenv("XDG_CACHE_HOME")) && base[0] == '/')
+            snprintf(cache_dir, sizeof(cache_dir), "%s/spank_lmod", base);
+        else if ((base = getenv("HOME")) && base[0] == '/')
+            snprintf(cache_dir, sizeof(cache_dir), "%s/.cache/spank_lmod", base);
+        else
+            cache_disabled = 1;
+    }
+    return 0;
+}
+
+/* the mmap()ed module index */
+typedef struct module_index {
+    const char *data;
+    size_t size;
+    size_t start;   // of the first entry
+} module_index_t;
+
+/* a module of --module, resolved through the index */
+typedef struct module {
+    const char *name;   // as given
+    size_t name_len;
+    const char *entry;  // of the full name
+} module_t;
+
+/* compares the key of the line to key */
+static int _index_cmp(const char *line, const char *end, const char *key, size_t len) {
+    size_t i;
+    for (i = 0; i < len && line + i < end && line[i] != '\t' && line[i] != '\n'; i++) {
+        if (line[i] != key[i])
+            return (unsigned char)line[i] < (unsigned char)key[i] ? -1 : 1;
+    }
+    if (i < len)
+        return -1;
+    return (line + i < end && line[i] != '\t' && line[i] != '\n') ? 1 : 0;
+}
+
+/* the first line whose key isn't less than key */
+static const char *_index_lower_bound(const module_index_t *index, const char *key, size_t len) {
+    const char *end = index->data + index->size;
+    size_t lo = index->start, hi = index->size;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const char *line, *next;
+        while (mid > lo && index->data[mid - 1] != '\n')
+            mid--;
+        line = index->data + mid;
+        if (_index_cmp(line, end, key, len) >= 0) {
+            hi = mid;
+            continue;
+        }
+        next = memchr(line, '\n', end - line);
+        lo = next ? next - index->data + 1 : index->size;
+    }
+    return index->data + lo;
+}
+
+/* the line of key, NULL if not there */
+static const char *_index_find(const module_index_t *index, const char *key, size_t len) {
+    const char *line = _index_lower_bound(index, key, len);
+    const char *end = index->data + index->size;
+    if (line < end && _index_cmp(line, end, key, len) == 0)
+        return line;
+    return NULL;
+}
+
+/* field (0 is the key) of the line, and its length */
+static const char *_index_field(const module_index_t *index, const char *line, int field, size_t *len) {
+    const char *end = index->data + index->size;
+    for (; field > 0 && line < end; field--) {
+        while (line < end && *line != '\t' && *line != '\n')
+            line++;
+        if (line == end || *line == '\n') {
+            *len = 0;
+            return line;
+        }
+        line++;
+    }
+    *len = 0;
+    while (line + *len < end && line[*len] != '\t' && line[*len] != '\n')
+        (*len)++;
+    return line;
+}
+
+/*
+  the next part of a version: a run of digits (*number is set) or of other
+  characters but '.', which separates parts. Returns its length, 0 at the end.
+*/
+static size_t _version_part(const char **version, const char *end, int *number) {
+    const char *start;
+    while (*version < end && **version == '.')
+        (*version)++;
+    start = *version;
+    *number = start < end && isdigit((unsigned char)*start);
+    while (*version < end && **version != '.' &&
+           (isdigit((unsigned char)**version) != 0) == *number)
+        (*version)++;
+    return *version - start;
+}
+
+/*
+  compares versions like lmod (and version_key of lmod-module-index.py): parts
+  of digits numerically and before other parts, which compare as strings
+*/
+static int _version_cmp(const char *a, size_t alen, const char *b, size_t blen) {
+    const char *aend = a + alen, *bend = b + blen;
+    for (;;) {
+        int anum, bnum, rc;
+        const char *apart, *bpart;
+        size_t al, bl;
+        al = _version_part(&a, aend, &anum);
+        apart = a - al;
+        bl = _version_part(&b, bend, &bnum);
+        bpart = b - bl;
+        if (!al || !bl)
+            return al ? 1 : bl ? -1 : 0;
+        if (anum != bnum)
+            return anum ? -1 : 1;
+        if (anum) {
+            // without leading zeros, a longer number is larger
+            while (al > 1 && *apart == '0') {
+                apart++;
+                al--;
+            }
+            while (bl > 1 && *bpart == '0') {
+                bpart++;
+                bl--;
+            }
+            if (al != bl)
+                return al < bl ? -1 : 1;
+            rc = memcmp(apart, bpart, al);
+        } else {
+            rc = memcmp(apart, bpart, al < bl ? al : bl);
+            if (!rc && al != bl)
+                rc = al < bl ? -1 : 1;
+        }
+        if (rc)
+            return rc;
+    }
+}
+
+/*
+  resolves the module to the line of its full name: name is its default,
+  name/version itself, and name/<version prefix> (lmod's extended default) the
+  highest of the versions starting with <version prefix>.
+*/
+static const char *_index_resolve(const module_index_t *index, const char *name, size_t len) {
+    const char *end = index->data + index->size;
+    const char *line = _index_find(index, name, len), *match = NULL;
+    const char *def, *slash, *version = NULL;
+    size_t def_len, key_len, version_len = 0;
+
+    if (line) {
+        def = _index_field(index, line, 1, &def_len);
+        if (!def_len)
+            return line;
+        return _index_find(index, def, def_len);
+    }
+    slash = memrchr(name, '/', len);
+    if (!slash)
+        return NULL;
+    // all keys starting with name are together, but not only name. ones
+    // (e.g. gcc/12-cuda is between gcc/12 and gcc/12.1)
+    for (line = _index_lower_bound(index, name, len); line < end; ) {
+        const char *next = memchr(line, '\n', end - line);
+        _index_field(index, line, 0, &key_len);
+        if (key_len <= len || strncmp(line, name, len))
             break;
-        buf_ptr = end_line + 1;
+        if (line[len] == '.') {
+            const char *v = line + (slash - name) + 1;
+            size_t vlen = key_len - (v - line);
+            if (!match || _version_cmp(v, vlen, version, version_len) > 0) {
+                match = line;
+                version = v;
+                version_len = vlen;
+            }
+        }
+        line = next ? next + 1 : end;
     }
-    return;
+    return match;
 }
 
+static size_t _levenshtein(const char *a, size_t alen, const char *b, size_t blen) {
+    size_t row[256], prev, tmp;
+    if (alen >= sizeof(row) / sizeof(row[0]))
+        return alen;
+    for (size_t i = 0; i <= alen; i++)
+        row[i] = i;
+    for (size_t j = 1; j <= blen; j++) {
+        prev = row[0];
+        row[0] = j;
+        for (size_t i = 1; i <= alen; i++) {
+            tmp = row[i];
+            row[i] = prev + (a[i - 1] != b[j - 1]);
+            if (row[i - 1] + 1 < row[i])
+                row[i] = row[i - 1] + 1;
+            if (tmp + 1 < row[i])
+                row[i] = tmp + 1;
+            prev = tmp;
+        }
+    }
+    return row[alen];
+}
+
+/* the closest key to name (only on errors, so a linear scan is fine) */
+static const char *_index_suggest(const module_index_t *index, const char *name, size_t len, size_t *best_len) {
+    const char *end = index->data + index->size, *best = NULL;
+    size_t best_dist = len / 3 + 2;
+
+    for (const char *line = index->data + index->start; line < end; ) {
+        size_t key_len;
+        const char *next = memchr(line, '\n', end - line);
+        _index_field(index, line, 0, &key_len);
+        size_t dist = _levenshtein(name, len, line, key_len);
+        if (dist < best_dist) {
+            best_dist = dist;
+            best = line;
+            *best_len = key_len;
+        }
+        line = next ? next + 1 : end;
+    }
+    return best;
+}
+
+/* true if the conflicts of entry a list the module b (by name or full name) */
+static int _index_conflicts(const module_index_t *index, const char *a, const char *b) {
+    size_t conflicts_len, b_len;
+    const char *conflicts = _index_field(index, a, 2, &conflicts_len);
+    const char *slash;
+
+    _index_field(index, b, 0, &b_len);
+    slash = b + b_len;
+    while (slash > b && *slash != '/')
+        slash--;
+    for (const char *p = conflicts; p < conflicts + conflicts_len; ) {
+        const char *comma = memchr(p, ',', conflicts + conflicts_len - p);
+        size_t len = (comma ? comma : conflicts + conflicts_len) - p;
+        if ((len == b_len && !strncmp(p, b, len)) ||
+            (slash > b && len == (size_t)(slash - b) && !strncmp(p, b, len)))
+            return 1;
+        p += len + 1;
+    }
+    return 0;
+}
+
+static int _index_open(module_index_t *index) {
+    struct stat st;
+    int fd;
+
+    if ((fd = open(index_path, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &st) < 0) {
+        slurm_debug("spank_lmod: can't open %s: %m", index_path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    index->size = st.st_size;
+    index->start = strlen(INDEX_HEADER);
+    index->data = index->size ? mmap(NULL, index->size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (index->data == MAP_FAILED) {
+        slurm_debug("spank_lmod: can't map %s: %m", index_path);
+        return -1;
+    }
+    if (index->size < index->start || strncmp(index->data, INDEX_HEADER, index->start)) {
+        slurm_error("spank_lmod: %s isn't a module index", index_path);
+        munmap((void *)index->data, index->size);
+        return -1;
+    }
+    return 0;
+}
 
 /*
- * Run a task prolog script.  Also read the stdout of the script and set
- * 	environment variables in the task's environment as specified
- *	in the script's standard output.
- * name IN: class of program ("system prolog", "user prolog", etc.)
- * path IN: pathname of program to run
- * job IN/OUT: pointer to associated job, can update job->env
- *	if prolog
- * RET 0 on success, -1 on failure.
+  checks the modules (comma or space separated) exist and don't conflict with
+  each other. Without a usable index everything is allowed
+  RET 0 if the modules are fine
+*/
+static int _check_modules(const char *list) {
+    module_index_t index;
+    module_t *mods = NULL;
+    size_t count = 0;
+    int rc = 0;
+
+    if (_index_open(&index))
+        return 0;
+
+    for (const char *p = list; *p && !rc; ) {
+        size_t len = strcspn(p, ", \t");
+        if (len) {
+            const char *entry = _index_resolve(&index, p, len);
+            if (!entry) {
+                size_t suggest_len = 0;
+                const char *suggest = _index_suggest(&index, p, len, &suggest_len);
+                if (suggest)
+                    slurm_error("spank_lmod: unknown module %.*s, did you mean %.*s?",
+                                (int)len, p, (int)suggest_len, suggest);
+                else
+                    slurm_error("spank_lmod: unknown module %.*s", (int)len, p);
+                rc = -1;
+                break;
+            }
+            mods = realloc(mods, (count + 1) * sizeof(module_t));
+            mods[count].name = p;
+            mods[count].name_len = len;
+            mods[count].entry = entry;
+            count++;
+        }
+        p += len;
+        p += strspn(p, ", \t");
+    }
+
+    for (size_t i = 0; i < count && !rc; i++) {
+        for (size_t j = 0; j < count && !rc; j++) {
+            if (i != j && _index_conflicts(&index, mods[i].entry, mods[j].entry)) {
+                slurm_error("spank_lmod: module %.*s conflicts with %.*s",
+                            (int)mods[i].name_len, mods[i].name,
+                            (int)mods[j].name_len, mods[j].name);
+                rc = -1;
+            }
+        }
+    }
+
+    free(mods);
+    munmap((void *)index.data, index.size);
+    return rc;
+}
+
+static void _buf_append(buf_t *buf, const char *data, size_t len) {
+    if (buf->len + len + 1 > buf->size) {
+        buf->size = (buf->len + len + 1) * 2;
+        buf->data = realloc(buf->data, buf->size);
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+}
+
+/* FNV-1a */
+#define HASH_INIT 0xcbf29ce484222325ULL
+
+static uint64_t _hash(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/* true if var (name or name=value) is in the comma separated list */
+static int _var_listed(const char *list, const char *var) {
+    size_t len = strcspn(var, "=");
+    for (const char *p = list; p && *p; ) {
+        size_t ilen = strcspn(p, ",");
+        if (ilen && p[ilen - 1] == '*') {
+            if (len >= ilen - 1 && strncmp(var, p, ilen - 1) == 0)
+                return 1;
+        } else if (ilen == len && strncmp(var, p, len) == 0) {
+            return 1;
+        }
+        p += ilen;
+        if (*p)
+            p++;
+    }
+    return 0;
+}
+
+static int _strcmp_p(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* the cache entry path of the current environment, NULL if not cached */
+static char *_cache_path(const char *script) {
+    size_t count = 0, n = 0;
+    uid_t uid = getuid();
+    uint64_t key = HASH_INIT;
+    char **vars, *path;
+    struct stat st;
+
+    if (cache_disabled)
+        return NULL;
+    if (mkdir(cache_dir, 0700) < 0 && errno == ENOENT) {
+        // ~/.cache itself
+        char parent[PATH_MAX];
+        char *slash;
+        snprintf(parent, sizeof(parent), "%s", cache_dir);
+        if ((slash = strrchr(parent, '/')) && slash != parent) {
+            *slash = '\0';
+            mkdir(parent, 0700);
+        }
+        mkdir(cache_dir, 0700);
+    }
+    // others must not be able to plant entries
+    if (lstat(cache_dir, &st) < 0 || !S_ISDIR(st.st_mode) || st.st_uid != uid ||
+        (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        slurm_debug("spank_lmod: not using cache directory %s", cache_dir);
+        return NULL;
+    }
+
+    for (char **env = environ; env && *env; env++)
+        count++;
+    vars = malloc((count + 1) * sizeof(char*));
+    for (char **env = environ; env && *env; env++) {
+        if (!_var_listed(cache_ignore, *env))
+            vars[n++] = *env;
+    }
+    // the order of environ doesn't matter
+    qsort(vars, n, sizeof(char*), _strcmp_p);
+
+    key = _hash(key, &uid, sizeof(uid));
+    key = _hash(key, script, strlen(script) + 1);
+    for (size_t i = 0; i < n; i++)
+        key = _hash(key, vars[i], strlen(vars[i]) + 1);
+    free(vars);
+
+    path = malloc(strlen(cache_dir) + 18);
+    sprintf(path, "%s/%016llx", cache_dir, (unsigned long long)key);
+    return path;
+}
+
+/*
+  hash of the inode, size and mtime of path, and for directories of the names
+  and mtimes of the entries (e.g. new module versions), 0 if it doesn't exist
+*/
+static uint64_t _stamp(const char *path) {
+    uint64_t hash = HASH_INIT;
+    struct stat st;
+    DIR *dir;
+    struct dirent *ent;
+
+    if (stat(path, &st) < 0)
+        return 0;
+    hash = _hash(hash, &st.st_ino, sizeof(st.st_ino));
+    hash = _hash(hash, &st.st_size, sizeof(st.st_size));
+    hash = _hash(hash, &st.st_mtim, sizeof(st.st_mtim));
+    if (S_ISDIR(st.st_mode) && (dir = opendir(path))) {
+        uint64_t entries = 0;
+        while ((ent = readdir(dir))) {
+            if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+                continue;
+            if (fstatat(dirfd(dir), ent->d_name, &st, 0) < 0)
+                continue;
+            // independent of the readdir order
+            uint64_t entry = _hash(HASH_INIT, ent->d_name, strlen(ent->d_name));
+            entries += _hash(entry, &st.st_mtim, sizeof(st.st_mtim));
+        }
+        closedir(dir);
+        hash = _hash(hash, &entries, sizeof(entries));
+    }
+    return hash ? hash : 1;
+}
+
+/* appends a stamp line for each path of the colon separated list */
+static void _add_stamps(buf_t *buf, const char *paths, size_t len) {
+    char path[PATH_MAX], line[PATH_MAX + 32];
+    const char *end = paths + len;
+
+    while (paths < end) {
+        size_t plen = strcspn(paths, ":\n");
+        if (paths + plen > end)
+            plen = end - paths;
+        if (plen && plen < sizeof(path)) {
+            memcpy(path, paths, plen);
+            path[plen] = '\0';
+            snprintf(line, sizeof(line), "stamp %016llx %s\n", (unsigned long long)_stamp(path), path);
+            // MODULEPATH before and after may have the same directories
+            if (!buf->data || !strstr(buf->data, line))
+                _buf_append(buf, line, strlen(line));
+        }
+        paths += plen + 1;
+    }
+}
+
+static void _add_stamp_var(buf_t *buf, const char *value) {
+    if (value)
+        _add_stamps(buf, value, strlen(value));
+}
+
+/* the stamps of everything the script output depends on */
+static void _cache_stamps(buf_t *buf, const char *script, const script_output_t *output) {
+    const char *home = getenv("HOME");
+
+    _add_stamp_var(buf, script);
+    _add_stamp_var(buf, "/etc/lmod/lmodrc");
+    if (home) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/.lmodrc", home);
+        _add_stamp_var(buf, path);
+    }
+    _add_stamp_var(buf, cache_stamps);
+    _add_stamp_var(buf, getenv("MODULEPATH"));
+    // the module path after module reset
+    for (size_t i = 0; i < output->count; i++) {
+        const env_change_t *change = &output->changes[i];
+        if (!change->unset && change->name_len == 10 &&
+            strncmp(output->buf.data + change->name, "MODULEPATH", 10) == 0)
+            _add_stamps(buf, output->buf.data + change->value, change->value_len);
+    }
+}
+
+static void _parse_output(script_output_t *output, int final);
+
+/* reads the script output of a valid entry, returns 0 if there's none */
+static int _cache_read(const char *path, script_output_t *output) {
+    struct stat st;
+    buf_t buf = { NULL, 0, 0 };
+    char *line;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) < 0)
+        return 0;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_uid != getuid() ||
+        st.st_size > CACHE_MAX_SIZE) {
+        close(fd);
+        goto invalid;
+    }
+    buf.size = st.st_size + 1;
+    buf.data = malloc(buf.size);
+    while (buf.len < (size_t)st.st_size) {
+        ssize_t n = read(fd, buf.data + buf.len, st.st_size - buf.len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        buf.len += n;
+    }
+    close(fd);
+    buf.data[buf.len] = '\0';
+
+    if (strncmp(buf.data, CACHE_HEADER, strlen(CACHE_HEADER)))
+        goto invalid;
+    for (line = buf.data + strlen(CACHE_HEADER); strncmp(line, "stamp ", 6) == 0; ) {
+        char *end = strchr(line, '\n');
+        char *path_start = line + 6 + 17;
+        unsigned long long stamp;
+        if (!end || end - line < 6 + 17 || sscanf(line + 6, "%16llx", &stamp) != 1)
+            goto invalid;
+        *end = '\0';
+        if (_stamp(path_start) != stamp) {
+            slurm_debug("spank_lmod: %s changed", path_start);
+            goto invalid;
+        }
+        line = end + 1;
+    }
+    if (strncmp(line, "--\n", 3))
+        goto invalid;
+    _buf_append(&output->buf, line + 3, buf.len - (line + 3 - buf.data));
+    _parse_output(output, 1);
+    free(buf.data);
+    return 1;
+
+invalid:
+    free(buf.data);
+    unlink(path);
+    return 0;
+}
+
+/* removes entries (and leftover temporary files) older than cache_age */
+static void _cache_expire(void) {
+    time_t now = time(NULL);
+    struct dirent *ent;
+    struct stat st;
+    DIR *dir;
+
+    if (!(dir = opendir(cache_dir)))
+        return;
+    while ((ent = readdir(dir))) {
+        if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+            continue;
+        if (fstatat(dirfd(dir), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+            S_ISREG(st.st_mode) && now - st.st_mtime > cache_age)
+            unlinkat(dirfd(dir), ent->d_name, 0);
+    }
+    closedir(dir);
+}
+
+/* writes the entry atomically, so concurrent readers see the old or the new one */
+static void _cache_write(const char *path, const char *script, const script_output_t *output) {
+    buf_t buf = { NULL, 0, 0 };
+    char tmp[PATH_MAX];
+    size_t done = 0;
+    int fd;
+
+    _cache_expire();
+
+    _buf_append(&buf, CACHE_HEADER, strlen(CACHE_HEADER));
+    _cache_stamps(&buf, script, output);
+    _buf_append(&buf, "--\n", 3);
+    _buf_append(&buf, output->buf.data, output->buf.len);
+
+    snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600)) < 0) {
+        slurm_debug("spank_lmod: can't create %s: %m", tmp);
+        free(buf.data);
+        return;
+    }
+    while (done < buf.len) {
+        ssize_t n = write(fd, buf.data + done, buf.len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    if (close(fd) < 0 || done < buf.len || rename(tmp, path) < 0) {
+        slurm_debug("spank_lmod: can't write %s: %m", path);
+        unlink(tmp);
+    }
+    free(buf.data);
+}
+
+static void _add_change(script_output_t *output, const env_change_t *change) {
+    if (output->count == output->size) {
+        output->size = output->size ? output->size * 2 : 64;
+        output->changes = realloc(output->changes, output->size * sizeof(env_change_t));
+    }
+    output->changes[output->count++] = *change;
+}
+
+/*
+  parses a line of the output ("export name=value" or "unset name"), other
+  lines are ignored
+*/
+static void _parse_line(script_output_t *output, size_t start, size_t len) {
+    const char *line = output->buf.data + start;
+    env_change_t change = { 0, 0, 0, 0, 0 };
+    size_t pos, end;
+
+    if (len > 7 && !strncmp(line, "export ", 7)) {
+        const char *equal;
+        for (pos = 7; pos < len && isspace(line[pos]); pos++)
+            ;
+        if (!(equal = memchr(line + pos, '=', len - pos)))
+            return;
+        change.value = start + (equal - line) + 1;
+        change.value_len = len - (equal - line) - 1;
+        for (end = equal - line; end > pos && isspace(line[end - 1]); end--)
+            ;
+    } else if (len > 6 && !strncmp(line, "unset ", 6)) {
+        for (pos = 6; pos < len && isspace(line[pos]); pos++)
+            ;
+        for (end = len; end > pos && isspace(line[end - 1]); end--)
+            ;
+        change.unset = 1;
+    } else {
+        return;
+    }
+    if (end == pos)
+        return;
+    change.name = start + pos;
+    change.name_len = end - pos;
+    _add_change(output, &change);
+}
+
+/* parses the complete lines read so far, and the last one if final */
+static void _parse_output(script_output_t *output, int final) {
+    char *end_line;
+
+    while ((end_line = memchr(output->buf.data + output->parsed, '\n', output->buf.len - output->parsed))) {
+        size_t len = end_line - (output->buf.data + output->parsed);
+        _parse_line(output, output->parsed, len);
+        output->parsed += len + 1;
+    }
+    if (final && output->parsed < output->buf.len) {
+        _parse_line(output, output->parsed, output->buf.len - output->parsed);
+        output->parsed = output->buf.len;
+    }
+}
+
+/*
+  stat() results of the pruned directories, so directories in several
+  variables (or steps of the same slurmstepd) are checked once
+*/
+#define DIR_CACHE_SIZE 1024
+
+typedef struct dir_cache_entry {
+    char *path;
+    int exists;
+} dir_cache_entry_t;
+
+static dir_cache_entry_t dir_cache[DIR_CACHE_SIZE];
+
+static int _dir_exists(const char *path, size_t len) {
+    char buf[PATH_MAX];
+    struct stat st;
+    size_t i;
+    int exists;
+
+    if (len >= sizeof(buf))
+        return 1;
+    memcpy(buf, path, len);
+    buf[len] = '\0';
+
+    i = _hash(HASH_INIT, buf, len) % DIR_CACHE_SIZE;
+    for (size_t n = 0; n < DIR_CACHE_SIZE && dir_cache[i].path; n++, i = (i + 1) % DIR_CACHE_SIZE) {
+        if (strcmp(dir_cache[i].path, buf) == 0)
+            return dir_cache[i].exists;
+    }
+    // only what's surely not there, not e.g. a file system that isn't responding
+    exists = stat(buf, &st) == 0 || (errno != ENOENT && errno != ENOTDIR);
+    if (!dir_cache[i].path) {
+        dir_cache[i].path = strdup(buf);
+        dir_cache[i].exists = exists;
+    }
+    return exists;
+}
+
+/*
+  removes duplicate entries (and with prune non existing directories) from the
+  colon separated value, in place. Empty entries (the current directory in
+  PATH, the default path in MANPATH) are kept. returns the new length
+*/
+static size_t _compact_value(char *value, size_t len, int prune) {
+    size_t read = 0, write = 0;
+    int first = 1;
+
+    while (read <= len) {
+        size_t elen = 0, seen = 0;
+        const char *entry = value + read;
+        int keep = 1;
+
+        while (read + elen < len && entry[elen] != ':')
+            elen++;
+        if (elen) {
+            // is it already in value[0..write)?
+            while (seen < write && keep) {
+                size_t slen = 0;
+                while (seen + slen < write && value[seen + slen] != ':')
+                    slen++;
+                if (slen == elen && memcmp(value + seen, entry, elen) == 0)
+                    keep = 0;
+                seen += slen + 1;
+            }
+            if (keep && prune && entry[0] == '/' && !_dir_exists(entry, elen))
+                keep = 0;
+        }
+        if (keep) {
+            if (!first)
+                value[write++] = ':';
+            first = 0;
+            memmove(value + write, entry, elen);
+            write += elen;
+        }
+        read += elen + 1;
+    }
+    value[write] = '\0';
+    return write;
+}
+
+/* removes the drop variables from the process or job environment */
+static void _drop_vars(spank_t spank) {
+    char **env = environ, **names = NULL;
+    size_t count = 0;
+
+    if (spank && (spank_get_item(spank, S_JOB_ENV, &env) != ESPANK_SUCCESS || !env))
+        return;
+    // collected first, as removing changes env
+    for (char **var = env; *var; var++) {
+        if (_var_listed(drop_vars, *var)) {
+            names = realloc(names, (count + 1) * sizeof(char*));
+            names[count++] = strndup(*var, strcspn(*var, "="));
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        slurm_debug(" drop name:%s:", names[i]);
+        if (spank)
+            spank_unsetenv(spank, names[i]);
+        else
+            unsetenv(names[i]);
+        free(names[i]);
+    }
+    free(names);
+}
+
+/*
+  sets the variables in the process environment, or in the job environment if
+  spank is given. The output can't be parsed after this
+*/
+static void _apply_output(script_output_t *output, spank_t spank) {
+    for (size_t i = 0; i < output->count; i++) {
+        env_change_t *change = &output->changes[i];
+        char *name = output->buf.data + change->name;
+        char *value = output->buf.data + change->value;
+
+        name[change->name_len] = '\0';
+        if (!change->unset && _var_listed(drop_vars, name))
+            continue;
+        if (change->unset) {
+            slurm_debug(" unset name:%s:", name);
+            if (spank)
+                spank_unsetenv(spank, name);
+            else
+                unsetenv(name);
+            continue;
+        }
+        value[change->value_len] = '\0';
+        // the directories of the compute node, not of the submission host
+        if (_var_listed(compact_vars, name))
+            change->value_len = _compact_value(value, change->value_len, prune_dirs && spank);
+        slurm_debug("export name:%s:val:%s:", name, value);
+        if (spank ? spank_setenv(spank, name, value, 1) != ESPANK_SUCCESS
+                  : setenv(name, value, 1)) {
+            slurm_error("Unable to set %s environment variable", name);
+        }
+    }
+    if (drop_vars)
+        _drop_vars(spank);
+}
+
+static void _free_output(script_output_t *output) {
+    free(output->buf.data);
+    free(output->changes);
+}
+
+static long _now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Runs the script (with env, or the current environment) in its own process
+ * group and reads and parses its standard output. The script is started with
+ * posix_spawn(), which doesn't copy the (possibly large) srun process. If
+ * it doesn't finish within timeout seconds, the process group is killed.
+ * RET the wait status of the script, SCRIPT_TIMEOUT if it was killed, -1 if it
+ * couldn't be run.
  */
 static int
-_run_script_and_set_env(const char *path) {
-    int status, rc;
+_run_script(const char *path, char **env, script_output_t *output) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t sigs;
+    char *argv[2];
+    long deadline = timeout ? _now_ms() + timeout * 1000L : 0;
+    int status, rc, eof = 0;
     pid_t cpid;
     int pfd[2];
-    char buf[4096];
-    FILE *f;
-
-    if (path == NULL || path[0] == '\0')
-        return ESPANK_SUCCESS;
-
-    // slurm_debug("[job %u] attempting to run %s [%s]", job->jobid, name, path);
 
     if (access(path, R_OK | X_OK) < 0) {
         slurm_error("Could not run %s: %m", path);
-        return ESPANK_ERROR;
+        return -1;
     }
-    if (pipe(pfd) < 0) {
+    if (pipe2(pfd, O_CLOEXEC) < 0) {
         slurm_error("executing %s: pipe: %m", path);
-        return ESPANK_ERROR;
-    }
-    if ((cpid = fork()) < 0) {
-        slurm_error("executing %s: fork: %m", path);
-        return ESPANK_ERROR;
-    }
-    if (cpid == 0) {
-        char *argv[3];
-
-        argv[0] = strdup(path);
-        argv[1] = NULL;
-        argv[2] = "purge";
-        if (dup2(pfd[1], 1) == -1)
-            slurm_error("couldn't do the dup: %m");
-        close(2);
-        close(0);
-        close(pfd[0]);
-        close(pfd[1]);
-        setpgid(0, 0);
-        execv(path, argv);
-        slurm_error("execv(%s): %m", path);
-        exit(127);
+        return -1;
     }
 
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, pfd[1], 1);
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, 2, "/dev/null", O_WRONLY, 0);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK |
+                             POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setpgroup(&attr, 0);
+    sigemptyset(&sigs);
+    posix_spawnattr_setsigmask(&attr, &sigs);
+    sigfillset(&sigs);
+    posix_spawnattr_setsigdefault(&attr, &sigs);
+
+    argv[0] = (char *)path;
+    argv[1] = NULL;
+    rc = posix_spawn(&cpid, path, &actions, &attr, argv, env ? env : environ);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
     close(pfd[1]);
-    f = fdopen(pfd[0], "r");
-    if (f == NULL) {
-        slurm_error("Cannot open pipe device: %m");
-        return ESPANK_ERROR;
-    }
-    while (feof(f) == 0) {
-        if (fgets(buf, sizeof(buf) - 1, f) != NULL) {
-            _proc_stdout(buf);
-        }
+    if (rc) {
+        errno = rc;
+        slurm_error("executing %s: posix_spawn: %m", path);
+        close(pfd[0]);
+        return -1;
     }
-    fclose(f);
 
-    while (1) {
-        rc = waitpid(cpid, &status, 0);
-        if (rc < 0) {
-            if (errno == EINTR)
+    // read directly into the output, lines of any length
+    while (!eof) {
+        struct pollfd pollfd = { pfd[0], POLLIN, 0 };
+        int wait_ms = -1;
+        ssize_t n;
+
+        if (deadline && (wait_ms = deadline - _now_ms()) <= 0)
+            break;
+        if ((rc = poll(&pollfd, 1, wait_ms)) <= 0) {
+            if (rc < 0 && errno != EINTR) {
+                slurm_error("reading from %s: %m", path);
+                break;
+            }
+            continue;
+        }
+        if (output->buf.size - output->buf.len < 4096 + 1) {
+            output->buf.size = output->buf.size ? output->buf.size * 2 : 16384;
+            output->buf.data = realloc(output->buf.data, output->buf.size);
+        }
+        n = read(pfd[0], output->buf.data + output->buf.len, output->buf.size - output->buf.len - 1);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN)
                 continue;
-            slurm_error("waidpid: %m");
-            return 0;
-        } else  {
-            killpg(cpid, SIGKILL);  /* kill children too */
-            return status;
+            slurm_error("reading from %s: %m", path);
+            break;
         }
+        if (n == 0)
+            eof = 1;
+        output->buf.len += n;
+        output->buf.data[output->buf.len] = '\0';
+        _parse_output(output, eof);
+    }
+    close(pfd[0]);
+
+    if (!eof) {
+        slurm_error("spank_lmod: %s didn't finish in %u seconds, killing it", path, timeout);
+        killpg(cpid, SIGKILL);
+    }
+    while ((rc = waitpid(cpid, &status, 0)) < 0 && errno == EINTR)
+        ;
+    killpg(cpid, SIGKILL);  /* kill children too */
+    if (rc < 0) {
+        slurm_error("waidpid: %m");
+        return -1;
+    }
+    return eof ? status : SCRIPT_TIMEOUT;
+}
+
+/*
+ * Sets the environment variables as specified in the standard output of the
+ * script, from the cache if possible.
+ * RET 0 on success.
+ */
+static int
+_run_script_and_set_env(const char *path) {
+    script_output_t output;
+    char *cache_path;
+    int status;
+
+    if (path == NULL || path[0] == '\0')
+        return ESPANK_SUCCESS;
+
+    memset(&output, 0, sizeof(output));
+    cache_path = _cache_path(path);
+    if (cache_path && _cache_read(cache_path, &output)) {
+        slurm_debug("spank_lmod: using %s", cache_path);
+        _apply_output(&output, NULL);
+        _free_output(&output);
+        free(cache_path);
+        return ESPANK_SUCCESS;
     }
 
-    /* NOTREACHED */
+    status = _run_script(path, NULL, &output);
+    if (status == SCRIPT_TIMEOUT) {
+        // continue with the environment as is
+        status = ESPANK_SUCCESS;
+    } else if (status < 0) {
+        status = ESPANK_ERROR;
+    } else {
+        // only complete runs are cached
+        if (status == 0 && cache_path)
+            _cache_write(cache_path, path, &output);
+        _apply_output(&output, NULL);
+    }
+    _free_output(&output);
+    free(cache_path);
+    return status;
+}
+
+/*
+ * Runs the script with the job environment (as the TaskProlog would) and sets
+ * the variables in the job environment, so all the tasks get them.
+ * RET 0 on success.
+ */
+static int
+_run_script_and_set_job_env(spank_t spank, const char *path) {
+    script_output_t output;
+    char **job_env = NULL, **env;
+    size_t count = 0, n = 0;
+    int status;
+
+    if (path == NULL || path[0] == '\0')
+        return ESPANK_SUCCESS;
+    if (spank_get_item(spank, S_JOB_ENV, &job_env) != ESPANK_SUCCESS || !job_env) {
+        slurm_error("spank_lmod: can't get the job environment");
+        return ESPANK_SUCCESS;
+    }
+
+    for (char **var = job_env; *var; var++)
+        count++;
+    env = malloc((count + 1) * sizeof(char*));
+    for (char **var = job_env; *var; var++) {
+        if (strncmp(*var, LMOD_MARKER "=", strlen(LMOD_MARKER) + 1))
+            env[n++] = *var;
+    }
+    env[n] = NULL;
+
+    memset(&output, 0, sizeof(output));
+    status = _run_script(path, env, &output);
+    free(env);
+    if (status != 0) {
+        // leave it to the TaskProlog
+        slurm_error("spank_lmod: %s failed (%d), using the TaskProlog", path, status);
+        _free_output(&output);
+        return ESPANK_SUCCESS;
+    }
+    _apply_output(&output, spank);
+    _free_output(&output);
+    spank_setenv(spank, LMOD_MARKER, "1", 1);
+    return ESPANK_SUCCESS;
 }
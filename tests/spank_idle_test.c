@@ -0,0 +1,231 @@
+/******************************************************************************
+ *
+ *   spank_idle_test.c
+ *
+ *   Copyright (C) 2026 Hebrew University of Jerusalem Israel, see
+ *   LICENSE file.
+ *
+ *   Author: Yair Yarom <irush@cs.huji.ac.il>
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc., 59
+ *   Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ *****************************************************************************/
+
+/*
+  Tests spank_idle against a mocked cgroup tree (v2 cpu.stat and v1
+  cpuacct.usage) in a temporary directory. Linked with spank_idle.c, and
+  provides the spank and slurm functions it uses: the "job" is described by
+  the globals below, and slurm_kill_job() records the cancelled job.
+
+  Each case runs the monitor with interval=1 idle=2 for a few seconds.
+*/
+
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <slurm/slurm.h>
+#include <slurm/spank.h>
+
+extern int slurm_spank_init(spank_t spank, int ac, char **av);
+extern int slurm_spank_task_post_fork(spank_t spank, int ac, char **av);
+extern int slurm_spank_exit(spank_t spank, int ac, char **av);
+
+static uint32_t test_job_id;
+static uint32_t test_uid = 1000;
+static uint32_t test_stepid;
+static uint32_t test_nodeid;
+static uint32_t test_nodes;
+static char *test_licenses;
+static uint32_t killed_job;
+static int failures;
+
+/* spank and slurm stubs */
+
+void slurm_info(const char *fmt, ...) {}
+void slurm_debug(const char *fmt, ...) {}
+void slurm_error(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+int spank_remote(spank_t spank) {
+    return 1;
+}
+
+spank_err_t spank_get_item(spank_t spank, spank_item_t item, ...) {
+    va_list ap;
+    va_start(ap, item);
+    uint32_t *value = va_arg(ap, uint32_t *);
+    va_end(ap);
+    switch (item) {
+    case S_JOB_ID: *value = test_job_id; break;
+    case S_JOB_UID: *value = test_uid; break;
+    case S_JOB_STEPID: *value = test_stepid; break;
+    case S_JOB_NODEID: *value = test_nodeid; break;
+    default: return ESPANK_BAD_ARG;
+    }
+    return ESPANK_SUCCESS;
+}
+
+int slurm_load_job(job_info_msg_t **resp, uint32_t job_id, uint16_t show_flags) {
+    job_info_msg_t *msg = calloc(1, sizeof(*msg));
+    msg->record_count = 1;
+    msg->job_array = calloc(1, sizeof(job_info_t));
+    msg->job_array[0].job_id = job_id;
+    msg->job_array[0].licenses = test_licenses;
+    msg->job_array[0].partition = "debug";
+    msg->job_array[0].num_nodes = test_nodes;
+    *resp = msg;
+    return SLURM_SUCCESS;
+}
+
+void slurm_free_job_info_msg(job_info_msg_t *msg) {
+    free(msg->job_array);
+    free(msg);
+}
+
+int slurm_kill_job(uint32_t job_id, uint16_t signal, uint16_t flags) {
+    killed_job = job_id;
+    return SLURM_SUCCESS;
+}
+
+int slurm_notify_job(uint32_t job_id, char *message) {
+    return SLURM_SUCCESS;
+}
+
+/* the mocked cgroup tree */
+
+static char root[256];
+
+static void _mkdirs(const char *path) {
+    char dir[PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s", path);
+    for (char *p = dir + strlen(root) + 1; (p = strchr(p, '/')); p++) {
+        *p = 0;
+        mkdir(dir, 0755);
+        *p = '/';
+    }
+    mkdir(dir, 0755);
+}
+
+static void _write(const char *path, const char *fmt, long long value) {
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    fprintf(f, fmt, value);
+    fclose(f);
+    rename(tmp, path);
+}
+
+/* the cpu usage file of the job, creating its cgroup */
+static void _cgroup(bool v2, uint32_t job_id, char *path, size_t size) {
+    char dir[PATH_MAX];
+    if (v2)
+        snprintf(dir, sizeof(dir), "%s/system.slice/slurmstepd.scope/job_%u", root, job_id);
+    else
+        snprintf(dir, sizeof(dir), "%s/cpuacct/slurm/uid_%u/job_%u", root, test_uid, job_id);
+    _mkdirs(dir);
+    snprintf(path, size, "%s/%s", dir, v2 ? "cpu.stat" : "cpuacct.usage");
+}
+
+static void _set_usage(bool v2, const char *path, long long usec) {
+    if (v2)
+        _write(path, "usage_usec %lld\nuser_usec 0\nsystem_usec 0\n", usec);
+    else
+        _write(path, "%lld\n", usec * 1000);
+}
+
+/*
+  runs the monitor for about 4 seconds, with the job using busy_permille of a
+  cpu, and checks whether the job was cancelled
+*/
+static void _case(const char *name, bool v2, int busy_permille, bool expect_kill) {
+    char *av[] = { "interval=1", "idle=2", "warn=0", "cpu=1", NULL, NULL };
+    char cgroup_arg[PATH_MAX + 8];
+    char path[PATH_MAX];
+    long long usage = 1000000;
+
+    snprintf(cgroup_arg, sizeof(cgroup_arg), "cgroup=%s", root);
+    av[4] = cgroup_arg;
+    test_job_id++;
+    killed_job = 0;
+    _cgroup(v2, test_job_id, path, sizeof(path));
+    _set_usage(v2, path, usage);
+
+    slurm_spank_init(NULL, 5, av);
+    slurm_spank_task_post_fork(NULL, 5, av);
+    for (int i = 0; i < 8; i++) {
+        usleep(500000);
+        usage += busy_permille * 500;
+        _set_usage(v2, path, usage);
+    }
+    slurm_spank_exit(NULL, 5, av);
+
+    bool killed = killed_job == test_job_id;
+    printf("%s: %s\n", killed == expect_kill ? "ok" : "FAIL", name);
+    if (killed != expect_kill)
+        failures++;
+}
+
+int main(void) {
+    snprintf(root, sizeof(root), "/tmp/spank_idle_test.XXXXXX");
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    test_licenses = "interactive:1";
+    test_stepid = SLURM_EXTERN_CONT;
+    test_nodes = 1;
+    _case("idle job is cancelled (cgroup v2)", true, 0, true);
+    _case("idle job is cancelled (cgroup v1)", false, 0, true);
+    _case("busy job isn't cancelled (cgroup v2)", true, 500, false);
+    _case("busy job isn't cancelled (cgroup v1)", false, 500, false);
+    _case("usage below cpu= is idle", true, 5, true);
+    _case("usage above cpu= isn't idle", true, 20, false);
+
+    test_licenses = NULL;
+    _case("non interactive job isn't monitored", true, 0, false);
+    test_licenses = "interactive:2";
+
+    test_nodes = 2;
+    _case("multi node job isn't monitored", true, 0, false);
+    test_nodes = 1;
+
+    test_stepid = 0;
+    _case("regular step doesn't start a monitor", true, 0, false);
+    test_stepid = SLURM_EXTERN_CONT;
+
+    test_nodeid = 1;
+    _case("other nodes don't start a monitor", true, 0, false);
+    test_nodeid = 0;
+
+    char cmd[PATH_MAX + 16];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+    if (system(cmd) != 0)
+        fprintf(stderr, "can't remove %s\n", root);
+
+    printf("%d failures\n", failures);
+    return failures ? 1 : 0;
+}
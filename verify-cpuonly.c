@@ -0,0 +1,232 @@
+/******************************************************************************
+ *
+ *   verify-cpuonly.c
+ *
+ *   Copyright (C) 2026 Hebrew University of Jerusalem Israel, see
+ *   LICENSE file.
+ *
+ *   Author: Yair Yarom <irush@cs.huji.ac.il>
+ *
+ *   This program is free software; you can redistribute it and/or modify it
+ *   under the terms of the GNU General Public License as published by the Free
+ *   Software Foundation; either version 2 of the License, or (at your option)
+ *   any later version.
+ *
+ *   This program is distributed in the hope that it will be useful, but
+ *   WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *   or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ *   for more details.
+ *
+ *   You should have received a copy of the GNU General Public License along
+ *   with this program; if not, write to the Free Software Foundation, Inc., 59
+ *   Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ *****************************************************************************/
+
+/*
+  Verifies that every node either has a gpu gres or the cpuonly feature (but
+  not both), as required by job_submit_cpuonly.
+
+  All nodes are loaded with a single slurm_load_node() call, or read from the
+  output of "scontrol show node -o" (-f), so it can be run without a live
+  cluster.
+
+  Each violation is printed on a line of its own:
+  node=<name> problem=<missing_cpuonly|gpu_and_cpuonly> gres=<gres> features=<features>
+
+  With -u, the scontrol commands fixing the features are printed instead.
+
+  Exits with 0 if all nodes are fine, 1 if there are violations, 2 on errors.
+*/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <slurm/slurm.h>
+#include <slurm/slurm_errno.h>
+
+#define FEATURE "cpuonly"
+
+typedef struct node {
+    char* name;
+    char* gres;
+    char* features;     // available
+    char* features_act; // active
+} node_t;
+
+static bool update_commands = false;
+static int violations = 0;
+
+static void _usage(const char* prog) {
+    fprintf(stderr, "usage: %s [-f <file>] [-u]\n", prog);
+    fprintf(stderr, "  -f <file>   read nodes from \"scontrol show node -o\" output (- for stdin)\n");
+    fprintf(stderr, "  -u          print scontrol commands fixing the nodes\n");
+    exit(2);
+}
+
+/* true if the comma separated list has name, or name followed by one of the separators */
+static bool _list_has(const char* list, const char* name, const char* separators) {
+    size_t len = strlen(name);
+    if (!list)
+        return false;
+    for (const char* p = list; *p; ) {
+        size_t elen = strcspn(p, ",");
+        if (elen >= len && strncmp(p, name, len) == 0 &&
+            (elen == len || strchr(separators, p[len])))
+            return true;
+        p += elen;
+        if (*p)
+            p++;
+    }
+    return false;
+}
+
+/* gres such as gpu, gpu:4, gpu:a100:4(S:0-1) */
+static bool _has_gpu_gres(const char* gres) {
+    return _list_has(gres, "gpu", ":(");
+}
+
+static bool _has_feature(const char* features) {
+    return _list_has(features, FEATURE, "");
+}
+
+/* features with FEATURE added (add) or removed (!add), "" if none left */
+static char* _fix_features(const char* features, bool add) {
+    size_t size = (features ? strlen(features) : 0) + strlen(FEATURE) + 2;
+    char* res = malloc(size);
+    res[0] = 0;
+    if (features) {
+        for (const char* p = features; *p; ) {
+            size_t elen = strcspn(p, ",");
+            if (elen && !(elen == strlen(FEATURE) && strncmp(p, FEATURE, elen) == 0)) {
+                if (res[0])
+                    strcat(res, ",");
+                strncat(res, p, elen);
+            }
+            p += elen;
+            if (*p)
+                p++;
+        }
+    }
+    if (add) {
+        if (res[0])
+            strcat(res, ",");
+        strcat(res, FEATURE);
+    }
+    return res;
+}
+
+static void _check_node(const node_t* node) {
+    bool gpu = _has_gpu_gres(node->gres);
+    // the active features are the ones the scheduler uses
+    bool cpuonly = _has_feature(node->features_act);
+    if (gpu != cpuonly)
+        return;
+
+    violations++;
+    if (!update_commands) {
+        printf("node=%s problem=%s gres=%s features=%s\n", node->name,
+               gpu ? "gpu_and_" FEATURE : "missing_" FEATURE,
+               node->gres && *node->gres ? node->gres : "(null)",
+               node->features_act && *node->features_act ? node->features_act : "(null)");
+        return;
+    }
+
+    char* features = _fix_features(node->features, !gpu);
+    char* features_act = _fix_features(node->features_act, !gpu);
+    printf("scontrol update NodeName=%s AvailableFeatures=%s ActiveFeatures=%s\n", node->name,
+           features[0] ? features : "\"\"", features_act[0] ? features_act : "\"\"");
+    free(features);
+    free(features_act);
+}
+
+static int _check_slurm(void) {
+    node_info_msg_t* msg = NULL;
+    if (slurm_load_node((time_t) NULL, &msg, SHOW_ALL) != SLURM_SUCCESS) {
+        slurm_perror("slurm_load_node");
+        return -1;
+    }
+    for (uint32_t i = 0; i < msg->record_count; i++) {
+        node_info_t* info = &msg->node_array[i];
+        if (!info->name)
+            continue;
+        node_t node = { info->name, info->gres, info->features, info->features_act };
+        _check_node(&node);
+    }
+    slurm_free_node_info_msg(msg);
+    return 0;
+}
+
+/* value of key= in the "scontrol show node -o" line, NULL if not there */
+static char* _field(const char* line, const char* key) {
+    size_t len = strlen(key);
+    for (const char* p = line; *p; ) {
+        while (*p == ' ')
+            p++;
+        size_t tlen = strcspn(p, " \n");
+        if (tlen > len && strncmp(p, key, len) == 0 && p[len] == '=') {
+            char* value = strndup(p + len + 1, tlen - len - 1);
+            if (strcmp(value, "(null)") == 0)
+                value[0] = 0;
+            return value;
+        }
+        p += tlen;
+    }
+    return NULL;
+}
+
+static int _check_file(const char* path) {
+    FILE* f = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    char* line = NULL;
+    size_t size = 0;
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    while (getline(&line, &size, f) >= 0) {
+        node_t node;
+        node.name = _field(line, "NodeName");
+        if (!node.name)
+            continue;
+        node.gres = _field(line, "Gres");
+        node.features = _field(line, "AvailableFeatures");
+        node.features_act = _field(line, "ActiveFeatures");
+        _check_node(&node);
+        free(node.name);
+        free(node.gres);
+        free(node.features);
+        free(node.features_act);
+    }
+    free(line);
+    if (f != stdin)
+        fclose(f);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const char* file = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:uh")) != -1) {
+        switch (opt) {
+        case 'f':
+            file = optarg;
+            break;
+        case 'u':
+            update_commands = true;
+            break;
+        default:
+            _usage(argv[0]);
+        }
+    }
+    if (optind != argc)
+        _usage(argv[0]);
+
+    if ((file ? _check_file(file) : _check_slurm()) < 0)
+        return 2;
+
+    return violations ? 1 : 0;
+}